@@ -6,10 +6,17 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <learnopengl/shader_m.h>
+#include <learnopengl/shader_variants.h>
 #include <learnopengl/camera.h>
 #include <learnopengl/animator.h>
+#include <learnopengl/asset_loader.h>
+#include <learnopengl/clip_library.h>
 #include <learnopengl/model_animation.h>
 #include <learnopengl/blender.h>
+#include <learnopengl/uniform_buffer.h>
+#include <learnopengl/anim_benchmark.h>
+#include <learnopengl/crowd_benchmark.h>
+#include <learnopengl/skinned_crowd.h>
 
 
 #include <iostream>
@@ -19,6 +26,8 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window);
+int cookAssets(const std::string& modelPath, const std::vector<std::string>& animationPaths);
+int runScene(GLFWwindow* window, int argc, char* argv[]);
 
 // settings
 const unsigned int SCR_WIDTH = 1080;
@@ -34,8 +43,12 @@ bool firstMouse = true;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
-int main()
+int main(int argc, char* argv[])
 {
+	// headless timing runs, no window needed
+	if (argc > 1 && std::string(argv[1]) == "--bench")
+		return RunBenchmarks();
+
 	// glfw: initialize and configure
 	// ------------------------------
 	glfwInit();
@@ -69,9 +82,23 @@ int main()
 	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
 	{
 		std::cout << "Failed to initialize GLAD" << std::endl;
+		glfwTerminate();
 		return -1;
 	}
 
+	// everything owning GL objects lives in runScene, so it is gone before the context is
+	int result = runScene(window, argc, argv);
+
+	// glfw: terminate, clearing all previously allocated GLFW resources.
+	// ------------------------------------------------------------------
+	glfwTerminate();
+	return result;
+}
+
+// loads the character and runs the render loop until the window closes, or one of the command line modes
+// ---------------------------------------------------------------------------------------------------------
+int runScene(GLFWwindow* window, int argc, char* argv[])
+{
 	// tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
 	stbi_set_flip_vertically_on_load(true);
 
@@ -81,21 +108,59 @@ int main()
 
 	// build and compile shaders
 	// -------------------------
-	Shader AnimShader("Shaders/anim_model.vs", "Shaders/anim_model.fs");
+	// the character's meshes each get the skinning variant their bone weights need, built on first draw.
+	// anim_model.fs only samples the diffuse texture, so no normal-mapped variants
+	ShaderVariants AnimShaders("Shaders/anim_model.vs", "Shaders/anim_model.fs", ShaderKeySkinning | ShaderKeyInfluences | ShaderKeyPalette
+		| ShaderKeyPackedVertex | ShaderKeyInstanced | ShaderKeyBaked | ShaderKeyDualQuaternion | ShaderKeyLocalPalette);
+	AnimShaders.SetOnBuild([](Shader& shader)
+	{
+		shader.bindUniformBlock("Camera", CameraBlockBinding);
+		shader.bindUniformBlock("Character", CharacterBlockBinding);
+		shader.use();
+		shader.setInt("bonePalette", PaletteTextureUnit);
+		shader.bindUniformBlock("BakedClips", BakedClipsBlockBinding);
+		shader.setInt("bakedPalette", BakedPaletteTextureUnit);
+	});
 
 	Shader BoneShader("Shaders/bone.vs", "Shaders/bone.fs");
 
+	// the bone program reads the camera and the character from the same blocks as the skinned ones
+	BoneShader.bindUniformBlock("Camera", CameraBlockBinding);
+	BoneShader.bindUniformBlock("Character", CharacterBlockBinding);
+	UniformRing Uniforms(UniformRing::GetAlignedSize<CameraBlock>() + 8 * UniformRing::GetAlignedSize<CharacterBlock>());
+
+	// the characters' palettes for the instanced draw, sized to the rig once it has loaded
+	std::unique_ptr<SkinnedCrowd> Crowd;
+	const bool CrowdBenchmark = argc > 1 && std::string(argv[1]) == "--crowd-bench";
+	// --dqs skins the characters with dual quaternions, one Character block and draw each
+	const bool DualQuatSkinning = argc > 1 && std::string(argv[1]) == "--dqs";
+	// --partition splits the character's meshes so each draw sets at most PartitionBones matrices
+	const bool Partitioned = argc > 1 && std::string(argv[1]) == "--partition";
+	const int PartitionBones = 32;
+
 
 	// load models
 	// -----------
-	Model Model("resources/objects/Breakdance Ready.fbx");
-	Animation PullingAnimation("resources/objects/Breakdance Ready.fbx", &Model);
-	Animator Pullinganimator(&PullingAnimation);
+	const std::string ModelPath = "resources/objects/Breakdance Ready.fbx";
+	const std::string PunchPath = "resources/objects/Taking Punch.fbx";
 
-	Animation WalkingAnimation("resources/objects/Taking Punch.fbx", &Model);
-	Animator Walkinganimator(&WalkingAnimation);
+	// --cook writes the cooked files next to their sources, later launches map them instead of importing
+	if (argc > 1 && std::string(argv[1]) == "--cook")
+	{
+		return cookAssets(ModelPath, { PunchPath });
+	}
+
+	// the model and its animations load on worker threads while the render loop runs, the GL objects are
+	// created by Loader.Update() a few milliseconds per frame
+	AssetLoader Loader(GetThreadPool());
+	std::shared_future<std::shared_ptr<LoadedModel>> Loading = Loader.LoadModel(ModelPath, { PunchPath }, Partitioned ? PartitionBones : 0);
+	const double UploadBudgetMs = 4.0;
 
-	Blender blender(&Pullinganimator, &Walkinganimator, 0.5);
+	std::shared_ptr<LoadedModel> Character;
+	std::unique_ptr<Animator> Pullinganimator;
+	std::unique_ptr<Animator> Walkinganimator;
+	std::unique_ptr<Blender> blender;
+	int shownProgress = -1;
 
 	// draw in wireframe
 	//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
@@ -115,68 +180,150 @@ int main()
 		// input
 		// -----
 		processInput(window);
-		blender.update(deltaTime);
+
+		// streaming: upload what the loader threads finished, start animating once everything is in
+		// -----------------------------------------------------------------------------------------
+		Loader.Update(UploadBudgetMs);
+		if (!Character && Loading.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+		{
+			try
+			{
+				Character = Loading.get();
+			}
+			catch (const std::exception& e)
+			{
+				std::cout << "Failed to load model: " << e.what() << std::endl;
+				return -1;
+			}
+			catch (...)
+			{
+				std::cout << "Failed to load model" << std::endl;
+				return -1;
+			}
+			ClipLibrary& Clips = *Character->clips;
+			if (Clips.GetNumClips() < 2)
+			{
+				std::cout << "Failed to load animations" << std::endl;
+				return -1;
+			}
+			Pullinganimator.reset(new Animator(Clips.Get(0)));
+			Walkinganimator.reset(new Animator(Clips.Get(Clips.GetNumClips() - 1)));
+			blender.reset(new Blender(Pullinganimator.get(), Walkinganimator.get(), 0.5));
+			Pullinganimator->SetDualQuatOutput(DualQuatSkinning);
+			Walkinganimator->SetDualQuatOutput(DualQuatSkinning);
+			Crowd.reset(new SkinnedCrowd(8, Character->model->GetBoneCount()));
+			glfwSetWindowTitle(window, "LearnOpenGL");
+			// the character's upload is done, so textures no model holds anymore can go
+			GetTextureCache().Purge();
+			GetTextureCache().PrintStats();
+		}
+		else if (!Character && static_cast<int>(Loader.GetProgress() * 100.0f) != shownProgress)
+		{
+			shownProgress = static_cast<int>(Loader.GetProgress() * 100.0f);
+			glfwSetWindowTitle(window, ("LearnOpenGL - loading " + std::to_string(shownProgress) + "%").c_str());
+		}
 
 		// render
 		// ------
 		glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		// don't forget to enable shader before setting uniforms
-		AnimShader.use();
+		// nothing to draw until the character has streamed in
+		if (!Character)
+		{
+			glfwSwapBuffers(window);
+			glfwPollEvents();
+			continue;
+		}
+		blender->update(deltaTime);
+		Model& Model = *Character->model;
 
 		// view/projection transformations
 		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
 		glm::mat4 view = camera.GetViewMatrix();
-		AnimShader.setMat4("projection", projection);
-		AnimShader.setMat4("view", view);
-
-		const std::vector<glm::mat4>& Pullingtransforms = Pullinganimator.GetFinalBoneMatrices();
-		for (int i = 0; i < Pullingtransforms.size(); ++i)
-			AnimShader.setMat4("finalBonesMatrices[" + std::to_string(i) + "]", Pullingtransforms[i]);
 
-		// render the loaded model
+		// place the models
 		glm::mat4 model_1 = glm::mat4(1.0f);
 		model_1 = glm::translate(model_1, glm::vec3(-1.5f, -1.3f, -2.0f)); // translate it down so it's at the center of the scene
 		model_1 = glm::scale(model_1, glm::vec3(.02f, .02f, .02f));	// it's a bit too big for our scene, so scale it down
-		AnimShader.setMat4("model", model_1);
-		Model.Draw(AnimShader);
-
-	
-		const std::vector<glm::mat4>& Walkingtransforms = Walkinganimator.GetFinalBoneMatrices();
-		for (int i = 0; i < Walkingtransforms.size(); ++i)
-			AnimShader.setMat4("finalBonesMatrices[" + std::to_string(i) + "]", Walkingtransforms[i]);
-
-		// render the loaded model
 		glm::mat4 model_2 = glm::mat4(1.0f);
-		model_2 = glm::translate(model_2, glm::vec3(0.0f, -1.3f, -2.0f)); // translate it down so it's at the center of the scene
-		model_2 = glm::scale(model_2, glm::vec3(.02f, .02f, .02f));	// it's a bit too big for our scene, so scale it down
-		AnimShader.setMat4("model", model_2);
-		Model.Draw(AnimShader);
-
-		const std::vector<glm::mat4>& Blendertransforms = blender.GetBlenderBoneMatrices();
-		for (int i = 0; i < Blendertransforms.size(); ++i)
-			AnimShader.setMat4("finalBonesMatrices[" + std::to_string(i) + "]", Blendertransforms[i]);
-
-		// render the loaded model
+		model_2 = glm::translate(model_2, glm::vec3(0.0f, -1.3f, -2.0f));
+		model_2 = glm::scale(model_2, glm::vec3(.02f, .02f, .02f));
 		glm::mat4 model_3 = glm::mat4(1.0f);
-		model_3 = glm::translate(model_3, glm::vec3(1.5f, -1.3f, -2.0f)); // translate it down so it's at the center of the scene
-		model_3 = glm::scale(model_3, glm::vec3(.02f, .02f, .02f));	// it's a bit too big for our scene, so scale it down
-		AnimShader.setMat4("model", model_3);
-		Model.Draw(AnimShader);
+		model_3 = glm::translate(model_3, glm::vec3(1.5f, -1.3f, -2.0f));
+		model_3 = glm::scale(model_3, glm::vec3(.02f, .02f, .02f));
+
+		// write the camera and each character's model matrix and palette to this frame's part of the ring,
+		// the bone overlay below only binds ranges of it
+		Uniforms.BeginFrame();
+		CameraBlock cameraBlock = { projection, view };
+		Uniforms.Bind(CameraBlockBinding, Uniforms.Push(cameraBlock), sizeof(CameraBlock));
+
+		CharacterBlock characterBlock;
+		characterBlock.model = model_1;
+		characterBlock.SetPalette(Pullinganimator->GetFinalBoneMatrices());
+		GLintptr Pullingblock = Uniforms.Push(characterBlock);
+		characterBlock.model = model_2;
+		characterBlock.SetPalette(Walkinganimator->GetFinalBoneMatrices());
+		GLintptr Walkingblock = Uniforms.Push(characterBlock);
+		characterBlock.model = model_3;
+		characterBlock.SetPalette(blender->GetBlenderBoneMatrices());
+		GLintptr Blenderblock = Uniforms.Push(characterBlock);
+
+		// --crowd-bench times crowds of the first character once it is loaded, then quits
+		if (CrowdBenchmark)
+		{
+			return RunCrowdBenchmark(Model, AnimShaders, Pullinganimator->GetFinalBoneMatrices(), *Pullinganimator->getAnimation());
+		}
+
+		// render the loaded model, all three characters in one instanced draw per mesh (or a draw each with --dqs and --partition)
+		if (Partitioned)
+		{
+			// only the model matrix goes into the Character block, the draws set their bones
+			Uniforms.Bind(CharacterBlockBinding, Uniforms.Push(model_1), sizeof(glm::mat4));
+			Model.DrawPartitioned(AnimShaders, Pullinganimator->GetFinalBoneMatrices());
+			Uniforms.Bind(CharacterBlockBinding, Uniforms.Push(model_2), sizeof(glm::mat4));
+			Model.DrawPartitioned(AnimShaders, Walkinganimator->GetFinalBoneMatrices());
+			Uniforms.Bind(CharacterBlockBinding, Uniforms.Push(model_3), sizeof(glm::mat4));
+			Model.DrawPartitioned(AnimShaders, blender->GetBlenderBoneMatrices());
+		}
+		else if (DualQuatSkinning)
+		{
+			ShaderFeatures features;
+			features.dualQuaternion = true;
+			features.paletteSize = MaxDualQuatBones;
+			CharacterDualQuatBlock dualQuatBlock;
+			dualQuatBlock.model = model_1;
+			dualQuatBlock.SetPalette(Pullinganimator->GetFinalBoneDualQuats());
+			Uniforms.Bind(CharacterBlockBinding, Uniforms.Push(dualQuatBlock), sizeof(CharacterDualQuatBlock));
+			Model.Draw(AnimShaders, features);
+			dualQuatBlock.model = model_2;
+			dualQuatBlock.SetPalette(Walkinganimator->GetFinalBoneDualQuats());
+			Uniforms.Bind(CharacterBlockBinding, Uniforms.Push(dualQuatBlock), sizeof(CharacterDualQuatBlock));
+			Model.Draw(AnimShaders, features);
+			dualQuatBlock.model = model_3;
+			dualQuatBlock.SetPalette(blender->GetBlenderBoneMatrices());
+			Uniforms.Bind(CharacterBlockBinding, Uniforms.Push(dualQuatBlock), sizeof(CharacterDualQuatBlock));
+			Model.Draw(AnimShaders, features);
+		}
+		else
+		{
+			Crowd->Clear();
+			Crowd->Add(model_1, Pullinganimator->GetFinalBoneMatrices());
+			Crowd->Add(model_2, Walkinganimator->GetFinalBoneMatrices());
+			Crowd->Add(model_3, blender->GetBlenderBoneMatrices());
+			Crowd->Upload();
+			Crowd->Draw(Model, AnimShaders);
+		}
 
 		BoneShader.use();
-		BoneShader.setMat4("projection", projection);
-		BoneShader.setMat4("view", view);
-
-		BoneShader.setMat4("model", model_1);
-		Pullinganimator.DrawBones();
-
-		BoneShader.setMat4("model", model_2);
-		Walkinganimator.DrawBones();
-
-		BoneShader.setMat4("model", model_3);
-		blender.DrawBones();
+		Uniforms.Bind(CharacterBlockBinding, Pullingblock, sizeof(CharacterBlock));
+		Pullinganimator->DrawBones();
+		Uniforms.Bind(CharacterBlockBinding, Walkingblock, sizeof(CharacterBlock));
+		Walkinganimator->DrawBones();
+		Uniforms.Bind(CharacterBlockBinding, Blenderblock, sizeof(CharacterBlock));
+		blender->DrawBones();
+		Uniforms.EndFrame();
 		
 
 		// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
@@ -184,10 +331,6 @@ int main()
 		glfwSwapBuffers(window);
 		glfwPollEvents();
 	}
-
-	// glfw: terminate, clearing all previously allocated GLFW resources.
-	// ------------------------------------------------------------------
-	glfwTerminate();
 	return 0;
 }
 
@@ -242,4 +385,33 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
 	camera.ProcessMouseScroll(yoffset);
-}
\ No newline at end of file
+}
+
+// --cook: imports the model and its animations with Assimp, writes their cooked files and compares
+// the model's load time from Assimp and from the cooked file just written
+// ---------------------------------------------------------------------------------------------------------
+int cookAssets(const std::string& modelPath, const std::vector<std::string>& animationPaths)
+{
+	ClipLibrary clips;
+	auto start = std::chrono::high_resolution_clock::now();
+	const aiScene* scene = clips.Import(modelPath);
+	if (!scene)
+		return -1;
+	Model model(scene, modelPath);
+	auto end = std::chrono::high_resolution_clock::now();
+	double assimpMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+	bool cooked = model.Cook(scene, modelPath);
+	clips.LoadSource(modelPath, &model);
+	for (const std::string& path : animationPaths)
+		clips.LoadSource(path, &model);
+	cooked = clips.Cook() == 1 + static_cast<int>(animationPaths.size()) && cooked;
+	clips.ReleaseImport();
+
+	start = std::chrono::high_resolution_clock::now();
+	Model mapped(modelPath);
+	end = std::chrono::high_resolution_clock::now();
+	double cookedMs = std::chrono::duration<double, std::milli>(end - start).count();
+	std::cout << "Model load: Assimp " << assimpMs << " ms, cooked " << cookedMs << " ms" << std::endl;
+	return cooked ? 0 : -1;
+}
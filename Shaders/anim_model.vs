@@ -1,41 +1,249 @@
 #version 330 core
 
+// feature keys, set per variant by ShaderVariants; the defaults build the full skinned program
+#ifndef SKINNING
+#define SKINNING 1
+#endif
+#ifndef BONE_INFLUENCES
+#define BONE_INFLUENCES 4
+#endif
+#ifndef MAX_BONES
+#define MAX_BONES 100
+#endif
+#ifndef NORMAL_MAP
+#define NORMAL_MAP 0
+#endif
+#ifndef PACKED_VERTEX
+#define PACKED_VERTEX 0
+#endif
+#ifndef INSTANCED
+#define INSTANCED 0
+#endif
+#ifndef BAKED
+#define BAKED 0
+#endif
+#ifndef DUAL_QUATERNION
+#define DUAL_QUATERNION 0
+#endif
+#ifndef LOCAL_PALETTE
+#define LOCAL_PALETTE 0
+#endif
+#ifndef MAX_BAKED_CLIPS
+#define MAX_BAKED_CLIPS 32
+#endif
+
 layout(location = 0) in vec3 pos;
-layout(location = 1) in vec3 norm;
 layout(location = 2) in vec2 tex;
+#if PACKED_VERTEX
+// PackedVertex, see vertex_packing.h
+layout(location = 1) in vec2 normOct;
+#if NORMAL_MAP
+layout(location = 3) in ivec2 tangentOct;
+#endif
+#if SKINNING
+layout(location = 5) in uvec4 boneIds;
+layout(location = 6) in vec4 weights;
+#endif
+#else
+layout(location = 1) in vec3 norm;
+#if NORMAL_MAP
 layout(location = 3) in vec3 tangent;
 layout(location = 4) in vec3 bitangent;
-layout(location = 5) in ivec4 boneIds; 
+#endif
+#if SKINNING
+layout(location = 5) in ivec4 boneIds;
 layout(location = 6) in vec4 weights;
+#endif
+#endif
+#if INSTANCED
+// the instance's first entry in bonePalette, its model matrix; its bones follow. See SkinnedCrowd
+layout(location = 7) in int instanceBase;
+#if BAKED
+// the instance's clip in BakedClips and how many seconds it runs ahead, see BakedAnimation
+layout(location = 8) in int instanceClip;
+layout(location = 9) in float instanceTimeOffset;
+#endif
+#endif
 
-uniform mat4 projection;
-uniform mat4 view;
-uniform mat4 model;
+layout(std140) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+};
 
-const int MAX_BONES = 100;
-const int MAX_BONE_INFLUENCE = 4;
-uniform mat4 finalBonesMatrices[MAX_BONES];
+#if INSTANCED
+// three RGBA32F texels per matrix, its rows
+uniform samplerBuffer bonePalette;
+#if BAKED
+// a row per baked frame, three texels per bone
+uniform sampler2D bakedPalette;
+
+layout(std140) uniform BakedClips
+{
+    vec4 bakedClips[MAX_BAKED_CLIPS];   // first row, frames, duration in seconds
+    float bakedTime;
+};
+#endif
+#else
+layout(std140) uniform Character
+{
+    mat4 model;
+#if SKINNING && DUAL_QUATERNION
+    vec4 boneDualQuats[2 * MAX_BONES];  // real, dual; see dual_quaternion.h
+#elif SKINNING && !LOCAL_PALETTE
+    mat4 finalBonesMatrices[MAX_BONES];
+#endif
+};
+
+#if SKINNING && LOCAL_PALETTE
+// this draw's bones only, MAX_BONES is the partition size; see Model::DrawPartitioned
+uniform mat4 localBones[MAX_BONES];
+#endif
+#endif
 
 out vec2 TexCoords;
+out vec3 WorldPos;
+out vec3 Normal;
+#if NORMAL_MAP
+out mat3 TBN;
+#endif
+
+#if INSTANCED
+// the affine matrix of three rows
+mat4 rowsToMatrix(vec4 r0, vec4 r1, vec4 r2)
+{
+    return mat4(vec4(r0.x, r1.x, r2.x, 0.0), vec4(r0.y, r1.y, r2.y, 0.0), vec4(r0.z, r1.z, r2.z, 0.0), vec4(r0.w, r1.w, r2.w, 1.0));
+}
+
+mat4 fetchPalette(int entry)
+{
+    return rowsToMatrix(texelFetch(bonePalette, entry * 3), texelFetch(bonePalette, entry * 3 + 1), texelFetch(bonePalette, entry * 3 + 2));
+}
+#if BAKED
+// the two frames around the instance's time and how far between them, set once per vertex
+int bakedRow;
+float bakedBlend;
+
+mat4 fetchBaked(int bone)
+{
+    ivec2 texel = ivec2(bone * 3, bakedRow);
+    vec4 r0 = mix(texelFetch(bakedPalette, texel, 0), texelFetch(bakedPalette, texel + ivec2(0, 1), 0), bakedBlend);
+    vec4 r1 = mix(texelFetch(bakedPalette, texel + ivec2(1, 0), 0), texelFetch(bakedPalette, texel + ivec2(1, 1), 0), bakedBlend);
+    vec4 r2 = mix(texelFetch(bakedPalette, texel + ivec2(2, 0), 0), texelFetch(bakedPalette, texel + ivec2(2, 1), 0), bakedBlend);
+    return rowsToMatrix(r0, r1, r2);
+}
+#define boneMatrix(i) fetchBaked(i)
+#else
+#define boneMatrix(i) fetchPalette(instanceBase + 1 + (i))
+#endif
+#elif SKINNING && DUAL_QUATERNION
+// adds bone's dual quaternion to the sum, flipped onto pivot's hemisphere so q and -q don't cancel
+void addDualQuat(int bone, float weight, vec4 pivot, inout vec4 real, inout vec4 dual)
+{
+    vec4 boneReal = boneDualQuats[bone * 2];
+    float w = dot(pivot, boneReal) < 0.0 ? -weight : weight;
+    real += w * boneReal;
+    dual += w * boneDualQuats[bone * 2 + 1];
+}
+
+// the rigid transform of a blended dual quaternion, normalized here
+mat4 dualQuatToMatrix(vec4 real, vec4 dual)
+{
+    float len = length(real);
+    real /= len;
+    dual /= len;
+    vec3 v = real.xyz;
+    float w = real.w;
+    vec3 t = 2.0 * (w * dual.xyz - dual.w * v + cross(v, dual.xyz));
+    return mat4(
+        vec4(1.0 - 2.0 * (v.y * v.y + v.z * v.z), 2.0 * (v.x * v.y + w * v.z), 2.0 * (v.x * v.z - w * v.y), 0.0),
+        vec4(2.0 * (v.x * v.y - w * v.z), 1.0 - 2.0 * (v.x * v.x + v.z * v.z), 2.0 * (v.y * v.z + w * v.x), 0.0),
+        vec4(2.0 * (v.x * v.z + w * v.y), 2.0 * (v.y * v.z - w * v.x), 1.0 - 2.0 * (v.x * v.x + v.y * v.y), 0.0),
+        vec4(t, 1.0));
+}
+#elif LOCAL_PALETTE
+#define boneMatrix(i) localBones[i]
+#else
+#define boneMatrix(i) finalBonesMatrices[i]
+#endif
+
+#if PACKED_VERTEX
+// octahedral unit vector back to 3D
+vec3 octDecode(vec2 e)
+{
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (v.z < 0.0)
+        v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(v);
+}
+#endif
 
 void main()
 {
-    vec4 totalPosition = vec4(0.0f);
-    for(int i = 0 ; i < MAX_BONE_INFLUENCE ; i++)
-    {
-        if(boneIds[i] == -1) 
-            continue;
-        if(boneIds[i] >=MAX_BONES) 
-        {
-            totalPosition = vec4(pos,1.0f);
-            break;
-        }
-        vec4 localPosition = finalBonesMatrices[boneIds[i]] * vec4(pos,1.0f);
-        totalPosition += localPosition * weights[i];
-        vec3 localNormal = mat3(finalBonesMatrices[boneIds[i]]) * norm;
-   }
-	
-    mat4 viewModel = view * model;
-    gl_Position =  projection * viewModel * totalPosition;
-	TexCoords = tex;
-}
\ No newline at end of file
+#if INSTANCED
+    mat4 model = fetchPalette(instanceBase);
+#endif
+#if BAKED
+    // the clip loops, its last frame is its first again
+    vec4 clip = bakedClips[instanceClip];
+    float frame = fract((bakedTime + instanceTimeOffset) / clip.z) * (clip.y - 1.0);
+    int first = min(int(frame), int(clip.y) - 2);
+    bakedRow = int(clip.x) + first;
+    bakedBlend = frame - float(first);
+#endif
+#if SKINNING
+#if PACKED_VERTEX
+    ivec4 bones = ivec4(boneIds);
+#else
+    // unused slots hold bone -1 with weight 0, clamped so they read a valid matrix
+    ivec4 bones = max(boneIds, ivec4(0));
+#endif
+#if DUAL_QUATERNION && !INSTANCED
+    vec4 pivot = boneDualQuats[bones[0] * 2];
+    vec4 real = weights[0] * pivot;
+    vec4 dual = weights[0] * boneDualQuats[bones[0] * 2 + 1];
+#if BONE_INFLUENCES > 1
+    addDualQuat(bones[1], weights[1], pivot, real, dual);
+#endif
+#if BONE_INFLUENCES > 2
+    addDualQuat(bones[2], weights[2], pivot, real, dual);
+    addDualQuat(bones[3], weights[3], pivot, real, dual);
+#endif
+    mat4 skin = dualQuatToMatrix(real, dual);
+#else
+    mat4 skin = weights[0] * boneMatrix(bones[0]);
+#if BONE_INFLUENCES > 1
+    skin += weights[1] * boneMatrix(bones[1]);
+#endif
+#if BONE_INFLUENCES > 2
+    skin += weights[2] * boneMatrix(bones[2]);
+    skin += weights[3] * boneMatrix(bones[3]);
+#endif
+#endif
+    mat4 world = model * skin;
+#else
+    mat4 world = model;
+#endif
+
+    vec4 worldPos = world * vec4(pos, 1.0);
+    mat3 normalMatrix = mat3(world);    // rotation and uniform scale only
+    WorldPos = worldPos.xyz;
+#if PACKED_VERTEX
+    vec3 vertexNormal = octDecode(normOct);
+#else
+    vec3 vertexNormal = norm;
+#endif
+    Normal = normalize(normalMatrix * vertexNormal);
+#if NORMAL_MAP
+#if PACKED_VERTEX
+    vec3 vertexTangent = octDecode(clamp(vec2(tangentOct) / 32767.0, -1.0, 1.0));
+    vec3 vertexBitangent = ((tangentOct.y & 1) != 0 ? -1.0 : 1.0) * cross(vertexNormal, vertexTangent);
+#else
+    vec3 vertexTangent = tangent;
+    vec3 vertexBitangent = bitangent;
+#endif
+    TBN = mat3(normalize(normalMatrix * vertexTangent), normalize(normalMatrix * vertexBitangent), Normal);
+#endif
+    TexCoords = tex;
+    gl_Position = projection * view * worldPos;
+}
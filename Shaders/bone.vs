@@ -1,9 +1,20 @@
 #version 330 core
 layout (location = 0) in vec4 pos;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+const int MAX_BONES = 100;
+
+layout(std140) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+};
+
+// shared with anim_model.vs so a character's block is bound once for both passes
+layout(std140) uniform Character
+{
+    mat4 model;
+    mat4 finalBonesMatrices[MAX_BONES];
+};
 
 void main()
 {
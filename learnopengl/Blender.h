@@ -22,23 +22,29 @@ public:
 		ratio = ratio;
 	}
 
-	void ScanSkeleton(const BoneNodeData* node, const BoneNodeData* parent)
+	void ScanSkeleton()
 	{
-		std::string nodeName = node->name;
-		std::string parentName = parent ? parent->name : "";
-
-		auto boneInfoMap = m_Animator1->getAnimation()->GetBoneIDMap();
-		if (boneInfoMap.find(nodeName) != boneInfoMap.end() && boneInfoMap.find(parentName) != boneInfoMap.end())
+		const Skeleton& skeleton = m_Animator1->getAnimation()->GetSkeleton();
+		const std::vector<int>& parents = skeleton.GetParents();
+		const std::vector<int>& boneIDs = skeleton.GetBoneIDs();
+		m_BoneLink.clear();
+		for (int i = 0; i < skeleton.GetNumJoints(); i++)
 		{
-			int index = boneInfoMap[nodeName].id;
-			int parentIndex = boneInfoMap[parentName].id;
-			m_BoneLink.push_back(parentIndex);
-			m_BoneLink.push_back(index);
-
+			if (parents[i] < 0 || boneIDs[i] < 0 || boneIDs[parents[i]] < 0)
+				continue;
+			m_BoneLink.push_back(boneIDs[parents[i]]);
+			m_BoneLink.push_back(boneIDs[i]);
 		}
-		for (int i = 0; i < node->children.size(); i++)
-			ScanSkeleton(&node->children[i], node);
+	}
 
+	// animations of the same rig share one skeleton, otherwise their joints are matched by name once
+	void MatchJoints()
+	{
+		const Skeleton& skeleton1 = m_Animator1->getAnimation()->GetSkeleton();
+		const Skeleton& skeleton2 = m_Animator2->getAnimation()->GetSkeleton();
+		m_JointMatch.resize(skeleton1.GetNumJoints());
+		for (int i = 0; i < skeleton1.GetNumJoints(); i++)
+			m_JointMatch[i] = &skeleton1 == &skeleton2 ? i : skeleton2.FindJoint(skeleton1.GetNames()[i]);
 	}
 
 	void SetRatio(float r) { ratio = r; }
@@ -47,13 +53,12 @@ public:
 
 	void InitMatirices()
 	{
-		m_BlenderBoneMatrices.reserve(100);
-		m_BonePositions.reserve(100);
-		for (int i = 0; i < 100; i++) {
-			m_BlenderBoneMatrices.push_back(glm::mat4(1.0f));
-			m_BonePositions.push_back(glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-		}
-		ScanSkeleton(&m_Animator1->getAnimation()->GetRootNode(), nullptr);
+		// one entry per bone of the rig, like the animators'
+		int paletteSize = m_Animator1->getAnimation()->GetSkeleton().GetPaletteSize();
+		m_BlenderBoneMatrices.assign(paletteSize, glm::mat4(1.0f));
+		m_BonePositions.assign(paletteSize, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+		ScanSkeleton();
+		MatchJoints();
 		glGenVertexArrays(1, &VAO);
 		glGenBuffers(1, &VBO);
 		glGenBuffers(1, &EBO);
@@ -65,15 +70,18 @@ public:
 			if (m_Animator1->GetFinalBoneMatrices().size() != m_Animator2->GetFinalBoneMatrices().size()) return;
 			m_Animator1->UpdateAnimation(dt);
 			m_Animator2->UpdateAnimation(dt);
-			const std::vector<glm::mat4>& FinalBoneMatrices1 = m_Animator1->GetFinalBoneMatrices();
-			const std::vector<glm::mat4>& FinalBoneMatrices2 = m_Animator2->GetFinalBoneMatrices();
-			const std::vector<glm::vec4>& BonePosition1 = m_Animator1->GetBonePositions();
-			const std::vector<glm::vec4>& BonePosition2 = m_Animator2->GetBonePositions();
-			auto mNumBone = FinalBoneMatrices1.size();
-			for (int i = 0; i < mNumBone; i++) {
-				m_BlenderBoneMatrices[i] = (1 - ratio) * FinalBoneMatrices1[i] + ratio * FinalBoneMatrices2[i];
-				m_BonePositions[i] = (1 - ratio) * BonePosition1[i] + ratio * BonePosition2[i];
+
+			// blend the local TRS poses, then run the hierarchy once on the result
+			const std::vector<Transform>& LocalPoses1 = m_Animator1->GetLocalPoses();
+			const std::vector<Transform>& LocalPoses2 = m_Animator2->GetLocalPoses();
+			auto mNumJoint = LocalPoses1.size();
+			m_BlendedPoses.resize(mNumJoint);
+			for (size_t i = 0; i < mNumJoint; i++)
+			{
+				int match = m_JointMatch[i];
+				m_BlendedPoses[i] = match >= 0 ? BlendTransforms(LocalPoses1[i], LocalPoses2[match], ratio) : LocalPoses1[i];
 			}
+			m_Animator1->ApplyPose(m_BlendedPoses, m_BlenderBoneMatrices, m_BonePositions);
 
 		}
 	}
@@ -89,10 +97,10 @@ public:
 		glBindVertexArray(VAO);
 
 		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		glBufferData(GL_ARRAY_BUFFER, m_BonePositions.size() * sizeof(glm::vec4), &m_BonePositions[0], GL_STREAM_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, m_BonePositions.size() * sizeof(glm::vec4), m_BonePositions.data(), GL_STREAM_DRAW);
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_BoneLink.size() * sizeof(int), &m_BoneLink[0], GL_STREAM_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_BoneLink.size() * sizeof(int), m_BoneLink.data(), GL_STREAM_DRAW);
 
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
@@ -115,6 +123,10 @@ private:
 	std::vector<glm::vec4> m_BonePositions;
 	std::vector<unsigned int> m_BoneLink;
 
+	// pose
+	std::vector<Transform> m_BlendedPoses;
+	std::vector<int> m_JointMatch;	// joint of animation 2 for each joint of animation 1, -1 if it has none
+
 	// matrix
 	std::vector<glm::mat4> m_BlenderBoneMatrices;
 };
\ No newline at end of file
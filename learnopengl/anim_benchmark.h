@@ -0,0 +1,397 @@
+#pragma once
+
+/* Headless timing runs for the animation code, started with "OpenGL.exe --bench" */
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <string>
+#include <assimp/anim.h>
+#include <learnopengl/animation_clip.h>
+#include <learnopengl/bone.h>
+#include <learnopengl/clip_sampler.h>
+#include <learnopengl/cooked_animation.h>
+#include <learnopengl/dual_quaternion.h>
+#include <learnopengl/skeleton.h>
+#include <learnopengl/transform.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+// builds a channel with numKeys keys per track sampled at 30 ticks per second
+inline aiNodeAnim* MakeBenchmarkChannel(int numKeys)
+{
+	aiNodeAnim* channel = new aiNodeAnim();
+	channel->mNodeName.Set("BenchmarkBone");
+	channel->mNumPositionKeys = numKeys;
+	channel->mNumRotationKeys = numKeys;
+	channel->mNumScalingKeys = numKeys;
+	channel->mPositionKeys = new aiVectorKey[numKeys];
+	channel->mRotationKeys = new aiQuatKey[numKeys];
+	channel->mScalingKeys = new aiVectorKey[numKeys];
+	for (int i = 0; i < numKeys; i++)
+	{
+		double time = i;
+		float angle = 0.05f * i;
+		channel->mPositionKeys[i] = aiVectorKey(time, aiVector3D(std::sin(angle), std::cos(angle), 0.1f * i));
+		channel->mRotationKeys[i] = aiQuatKey(time, aiQuaternion(aiVector3D(0.0f, 1.0f, 0.0f), angle));
+		channel->mScalingKeys[i] = aiVectorKey(time, aiVector3D(1.0f + 0.01f * std::sin(angle)));
+	}
+	return channel;
+}
+
+// per-bone sampling cost of Bone::Update for clip lengths from 100 to 100k keys,
+// playing back at 60 fps so the cursor sees the usual mix of small steps and loop wraps
+inline void RunKeyframeLookupBenchmark()
+{
+	const int NumUpdates = 1000000;
+	const float TicksPerSecond = 30.0f;
+	const float DeltaTime = 1.0f / 60.0f;
+
+	std::cout << "Keyframe lookup: " << NumUpdates << " Bone::Update calls per clip length" << std::endl;
+	for (int numKeys = 100; numKeys <= 100000; numKeys *= 10)
+	{
+		aiAnimation animation;
+		animation.mNumChannels = 1;
+		animation.mChannels = new aiNodeAnim*[1];
+		animation.mChannels[0] = MakeBenchmarkChannel(numKeys);
+		AnimationClip clip(&animation);
+		Bone bone(&clip, 0, 0);
+		float duration = static_cast<float>(numKeys - 1);
+
+		float currentTime = 0.0f;
+		float checksum = 0.0f;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < NumUpdates; i++)
+		{
+			currentTime = fmod(currentTime + TicksPerSecond * DeltaTime, duration);
+			bone.Update(currentTime);
+			checksum += bone.GetLocalPose().translation.x;
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		double ns = std::chrono::duration<double, std::nano>(end - start).count() / NumUpdates;
+		std::cout << "  keys: " << numKeys << "\t" << ns << " ns/update (checksum " << checksum << ")" << std::endl;
+	}
+}
+
+// local pose to model space for a 64 bone chain: translate * toMat4 * scale with mat4 products
+// against ComposeAffine and MulAffine
+inline void RunPoseCompositionBenchmark()
+{
+	const int NumBones = 64;
+	const int NumUpdates = 100000;
+
+	std::vector<Transform> poses(NumBones);
+	std::vector<int> parents(NumBones);
+	for (int i = 0; i < NumBones; i++)
+	{
+		poses[i].translation = glm::vec3(0.0f, 10.0f, 0.1f * i);
+		poses[i].rotation = glm::angleAxis(0.01f * i, glm::normalize(glm::vec3(1.0f, 0.5f, 0.25f)));
+		poses[i].scale = glm::vec3(1.0f + 0.001f * i);
+		parents[i] = i / 2 - 1 + (i == 0);
+	}
+	parents[0] = -1;
+
+	std::vector<glm::mat4> matrices(NumBones);
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int n = 0; n < NumUpdates; n++)
+	{
+		for (int i = 0; i < NumBones; i++)
+		{
+			glm::mat4 translation = glm::translate(glm::mat4(1.0f), poses[i].translation);
+			glm::mat4 rotation = glm::toMat4(poses[i].rotation);
+			glm::mat4 scale = glm::scale(glm::mat4(1.0f), poses[i].scale);
+			glm::mat4 local = translation * rotation * scale;
+			matrices[i] = parents[i] < 0 ? local : matrices[parents[i]] * local;
+		}
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	double mat4Us = std::chrono::duration<double, std::micro>(end - start).count() / NumUpdates;
+
+	std::vector<glm::mat4x3> affines(NumBones);
+	start = std::chrono::high_resolution_clock::now();
+	for (int n = 0; n < NumUpdates; n++)
+	{
+		for (int i = 0; i < NumBones; i++)
+		{
+			glm::mat4x3 local = ComposeAffine(poses[i]);
+			affines[i] = parents[i] < 0 ? local : MulAffine(affines[parents[i]], local);
+		}
+	}
+	end = std::chrono::high_resolution_clock::now();
+	double affineUs = std::chrono::duration<double, std::micro>(end - start).count() / NumUpdates;
+
+	float maxDifference = 0.0f;
+	for (int i = 0; i < NumBones; i++)
+		for (int c = 0; c < 4; c++)
+			maxDifference = std::max(maxDifference, glm::length(glm::vec3(matrices[i][c]) - affines[i][c]));
+
+	std::cout << "Pose composition, " << NumBones << " bones: mat4 " << mat4Us << " us, affine " << affineUs
+		<< " us per character (max difference " << maxDifference << ")" << std::endl;
+}
+
+// whole-skeleton sampling: Bone::Update per track against ClipSampler on every instruction set the CPU has,
+// reporting the largest difference to the scalar Bone path
+inline void RunBatchedSamplingBenchmark()
+{
+	const int NumTracks = 64;
+	const int NumKeys = 300;
+	const int NumUpdates = 20000;
+	const float TicksPerSecond = 30.0f;
+	const float DeltaTime = 1.0f / 60.0f;
+
+	aiAnimation animation;
+	animation.mDuration = NumKeys - 1;
+	animation.mTicksPerSecond = TicksPerSecond;
+	animation.mNumChannels = NumTracks;
+	animation.mChannels = new aiNodeAnim*[NumTracks];
+	for (int i = 0; i < NumTracks; i++)
+	{
+		animation.mChannels[i] = MakeBenchmarkChannel(NumKeys);
+		// every fourth track turns fast enough between keys to take the slerp fallback
+		if (i % 4 == 3)
+			for (int key = 0; key < NumKeys; key++)
+				animation.mChannels[i]->mRotationKeys[key].mValue = aiQuaternion(aiVector3D(0.0f, 0.0f, 1.0f), 0.5f * key);
+	}
+	AnimationClip clip(&animation);
+	float duration = clip.GetDuration();
+
+	std::vector<Bone> bones;
+	for (int i = 0; i < NumTracks; i++)
+		bones.push_back(Bone(&clip, i, i));
+	float currentTime = 0.0f;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int n = 0; n < NumUpdates; n++)
+	{
+		currentTime = fmod(currentTime + TicksPerSecond * DeltaTime, duration);
+		for (Bone& bone : bones)
+			bone.Update(currentTime);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	std::cout << "Skeleton sampling, " << NumTracks << " tracks: Bone::Update "
+		<< std::chrono::duration<double, std::micro>(end - start).count() / NumUpdates << " us" << std::endl;
+
+	std::vector<Transform> poses(NumTracks);
+	for (int isa = SAMPLER_SCALAR; isa <= GetSamplerISA(); isa++)
+	{
+		ClipSampler sampler(&clip, static_cast<Sampler_ISA>(isa));
+		currentTime = 0.0f;
+		start = std::chrono::high_resolution_clock::now();
+		for (int n = 0; n < NumUpdates; n++)
+		{
+			currentTime = fmod(currentTime + TicksPerSecond * DeltaTime, duration);
+			sampler.Sample(currentTime, poses.data());
+		}
+		end = std::chrono::high_resolution_clock::now();
+
+		float maxError = 0.0f;
+		for (float time = 0.0f; time < duration; time += 0.37f)
+		{
+			sampler.Sample(time, poses.data());
+			for (int i = 0; i < NumTracks; i++)
+			{
+				bones[i].Update(time);
+				const Transform& expected = bones[i].GetLocalPose();
+				maxError = std::max(maxError, glm::length(expected.translation - poses[i].translation));
+				maxError = std::max(maxError, glm::length(expected.scale - poses[i].scale));
+				maxError = std::max(maxError, 1.0f - std::fabs(glm::dot(expected.rotation, poses[i].rotation)));
+			}
+		}
+		std::cout << "  ClipSampler " << GetSamplerISAName(static_cast<Sampler_ISA>(isa)) << ": "
+			<< std::chrono::duration<double, std::micro>(end - start).count() / NumUpdates << " us (max error " << maxError << ")" << std::endl;
+	}
+}
+
+struct BenchmarkNode
+{
+	std::string name;
+	std::vector<BenchmarkNode> children;
+};
+
+inline void CalculateBenchmarkNode(const BenchmarkNode& node, const glm::mat4x3& parentTransform, const std::map<std::string, int>& boneIDs,
+	const std::vector<glm::mat4x3>& offsets, const std::vector<Transform>& poses, std::vector<glm::mat4x3>& palette)
+{
+	int id = boneIDs.find(node.name)->second;
+	glm::mat4x3 globalTransformation = MulAffine(parentTransform, ComposeAffine(poses[id]));
+	palette[id] = MulAffine(globalTransformation, offsets[id]);
+	for (const BenchmarkNode& child : node.children)
+		CalculateBenchmarkNode(child, globalTransformation, boneIDs, offsets, poses, palette);
+}
+
+// hierarchy pass over a 64 bone binary tree: recursion over named nodes with a bone map lookup each,
+// against the flattened Skeleton loop
+inline void RunHierarchyBenchmark()
+{
+	const int NumBones = 64;
+	const int NumUpdates = 100000;
+
+	std::vector<Transform> poses(NumBones);
+	std::vector<glm::mat4x3> offsets(NumBones);
+	std::vector<BenchmarkNode> nodes(NumBones);
+	std::map<std::string, int> boneIDs;
+	Skeleton skeleton;
+	for (int i = 0; i < NumBones; i++)
+	{
+		poses[i].translation = glm::vec3(0.0f, 10.0f, 0.1f * i);
+		poses[i].rotation = glm::angleAxis(0.01f * i, glm::normalize(glm::vec3(1.0f, 0.5f, 0.25f)));
+		offsets[i] = glm::mat4x3(1.0f);
+		offsets[i][3] = glm::vec3(0.0f, -10.0f * i, 0.0f);
+		nodes[i].name = "mixamorig:Bone" + std::to_string(i);
+		boneIDs[nodes[i].name] = i;
+		skeleton.AddJoint(nodes[i].name, i == 0 ? -1 : (i - 1) / 2, poses[i], i, offsets[i]);
+	}
+	for (int i = NumBones - 1; i > 0; i--)
+		nodes[(i - 1) / 2].children.insert(nodes[(i - 1) / 2].children.begin(), nodes[i]);
+
+	std::vector<glm::mat4x3> recursivePalette(NumBones);
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int n = 0; n < NumUpdates; n++)
+		CalculateBenchmarkNode(nodes[0], glm::mat4x3(1.0f), boneIDs, offsets, poses, recursivePalette);
+	auto end = std::chrono::high_resolution_clock::now();
+	double recursiveUs = std::chrono::duration<double, std::micro>(end - start).count() / NumUpdates;
+
+	std::vector<glm::mat4x3> modelTransforms;
+	std::vector<glm::mat4x3> palette(NumBones);
+	const std::vector<int>& ids = skeleton.GetBoneIDs();
+	start = std::chrono::high_resolution_clock::now();
+	for (int n = 0; n < NumUpdates; n++)
+	{
+		skeleton.CalculateModelTransforms(poses, modelTransforms);
+		for (int i = 0; i < NumBones; i++)
+			palette[ids[i]] = MulAffine(modelTransforms[i], skeleton.GetOffsets()[i]);
+	}
+	end = std::chrono::high_resolution_clock::now();
+	double flatUs = std::chrono::duration<double, std::micro>(end - start).count() / NumUpdates;
+
+	float maxDifference = 0.0f;
+	for (int i = 0; i < NumBones; i++)
+		for (int c = 0; c < 4; c++)
+			maxDifference = std::max(maxDifference, glm::length(recursivePalette[i][c] - palette[i][c]));
+
+	std::cout << "Hierarchy, " << NumBones << " bones: recursive " << recursiveUs << " us, flattened " << flatUs
+		<< " us per character (max difference " << maxDifference << ")" << std::endl;
+}
+
+// building a 64 track clip from aiAnimation keys against mapping it from a cooked file, then checking
+// that the mapped clip samples exactly like the built one
+inline void RunCookedClipBenchmark()
+{
+	const int NumTracks = 64;
+	const int NumKeys = 300;
+	const char* Path = "anim_benchmark.anim";
+
+	aiAnimation animation;
+	animation.mDuration = NumKeys - 1;
+	animation.mTicksPerSecond = 30.0;
+	animation.mNumChannels = NumTracks;
+	animation.mChannels = new aiNodeAnim*[NumTracks];
+	Skeleton skeleton;
+	std::vector<int> trackJoints(NumTracks);
+	for (int i = 0; i < NumTracks; i++)
+	{
+		animation.mChannels[i] = MakeBenchmarkChannel(NumKeys);
+		animation.mChannels[i]->mNodeName.Set("Bone" + std::to_string(i));
+		trackJoints[i] = skeleton.AddJoint("Bone" + std::to_string(i), i - 1, Transform(), i, glm::mat4x3(1.0f));
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	AnimationClip clip(&animation);
+	auto end = std::chrono::high_resolution_clock::now();
+	double buildUs = std::chrono::duration<double, std::micro>(end - start).count();
+
+	FileStamp source;
+	std::vector<CookedClipSource> sources = { { "Benchmark", &clip, &trackJoints } };
+	if (!WriteCookedAnimation(Path, source, 0, skeleton, sources))
+	{
+		std::cout << "Cooked clip: could not write " << Path << std::endl;
+		return;
+	}
+
+	start = std::chrono::high_resolution_clock::now();
+	CookedAnimationFile file;
+	bool opened = file.Open(Path, source, 0) && file.MatchesSkeleton(skeleton);
+	std::shared_ptr<AnimationClip> mapped = opened ? file.GetClip(0) : nullptr;
+	end = std::chrono::high_resolution_clock::now();
+	double mapUs = std::chrono::duration<double, std::micro>(end - start).count();
+
+	bool identical = mapped && file.GetTrackJoints(0)[NumTracks - 1] == trackJoints[NumTracks - 1];
+	if (identical)
+	{
+		ClipSampler built(&clip), cooked(mapped.get());
+		std::vector<Transform> builtPoses(NumTracks), cookedPoses(NumTracks);
+		for (float time = 0.0f; time < clip.GetDuration() && identical; time += 0.37f)
+		{
+			built.Sample(time, builtPoses.data());
+			cooked.Sample(time, cookedPoses.data());
+			identical = std::memcmp(builtPoses.data(), cookedPoses.data(), NumTracks * sizeof(Transform)) == 0;
+		}
+	}
+	mapped.reset();
+	file = CookedAnimationFile();
+	std::remove(Path);
+
+	std::cout << "Cooked clip, " << NumTracks << " tracks x " << NumKeys << " keys: build " << buildUs << " us, map "
+		<< mapUs << " us (" << (identical ? "identical" : "MISMATCH") << ")" << std::endl;
+}
+
+// checks the dual quaternion reference against matrices and times the palette conversion. Single-bone vertices
+// have to land where the matrix puts them; a half-twisted joint shows what each blend does to the limb's radius
+inline void RunDualQuaternionBenchmark()
+{
+	const int NumBones = 100;
+	const int NumConversions = 10000;
+
+	std::vector<glm::mat4> matrices(NumBones);
+	std::vector<glm::dualquat> palette(NumBones);
+	for (int i = 0; i < NumBones; i++)
+	{
+		Transform transform;
+		transform.rotation = glm::angleAxis(0.37f * i, glm::normalize(glm::vec3(std::sin(1.3f * i), std::cos(0.7f * i), 0.5f)));
+		transform.translation = glm::vec3(std::sin(0.1f * i), 0.2f * i, std::cos(0.3f * i));
+		matrices[i] = ToMat4(ComposeAffine(transform));
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int n = 0; n < NumConversions; n++)
+		for (int i = 0; i < NumBones; i++)
+			palette[i] = DualQuaternion::FromMatrix(matrices[i]);
+	auto end = std::chrono::high_resolution_clock::now();
+	double convertNs = std::chrono::duration<double, std::nano>(end - start).count() / (double(NumConversions) * NumBones);
+
+	float rigidError = 0.0f;
+	for (int i = 0; i < NumBones; i++)
+	{
+		glm::vec4 position(std::cos(0.5f * i), 1.0f, std::sin(0.5f * i), 1.0f);
+		int ids[2] = { i, (i + 1) % NumBones };
+		float weights[2] = { 1.0f, 0.0f };
+		glm::vec3 expected = glm::vec3(matrices[i] * position);
+		glm::vec3 actual = DualQuaternion::ToAffine(DualQuaternion::Blend(palette.data(), ids, weights, 2)) * position;
+		rigidError = std::max(rigidError, glm::length(expected - actual));
+	}
+
+	// a vertex on a unit cylinder around x, weighted half to a fixed bone and half to one twisted about x
+	std::cout << "Dual quaternion skinning: " << convertNs << " ns per bone to convert, palette " << NumBones * 8 * sizeof(float)
+		<< " bytes instead of " << NumBones * sizeof(glm::mat4) << ", max single-bone error " << rigidError << std::endl;
+	for (int degrees = 45; degrees <= 180; degrees += 45)
+	{
+		glm::mat4 twist = glm::rotate(glm::mat4(1.0f), glm::radians(static_cast<float>(degrees)), glm::vec3(1.0f, 0.0f, 0.0f));
+		glm::dualquat twistPalette[2] = { DualQuaternion::FromMatrix(glm::mat4(1.0f)), DualQuaternion::FromMatrix(twist) };
+		int ids[2] = { 0, 1 };
+		float weights[2] = { 0.5f, 0.5f };
+		glm::vec4 position(0.0f, 1.0f, 0.0f, 1.0f);
+		glm::vec3 linear = glm::vec3((0.5f * glm::mat4(1.0f) + 0.5f * twist) * position);
+		glm::vec3 dual = DualQuaternion::ToAffine(DualQuaternion::Blend(twistPalette, ids, weights, 2)) * position;
+		std::cout << "  twist " << degrees << " degrees: radius linear " << glm::length(glm::vec2(linear.y, linear.z)) << ", dual quaternion "
+			<< glm::length(glm::vec2(dual.y, dual.z)) << std::endl;
+	}
+}
+
+inline int RunBenchmarks()
+{
+	RunKeyframeLookupBenchmark();
+	RunPoseCompositionBenchmark();
+	RunBatchedSamplingBenchmark();
+	RunHierarchyBenchmark();
+	RunCookedClipBenchmark();
+	RunDualQuaternionBenchmark();
+	return 0;
+}
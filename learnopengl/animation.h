@@ -6,38 +6,47 @@
 #include <assimp/scene.h>
 #include <learnopengl/bone.h>
 #include <functional>
+#include <memory>
+#include <learnopengl/animation_clip.h>
+#include <learnopengl/clip_compression.h>
+#include <learnopengl/clip_sampler.h>
+#include <learnopengl/skeleton.h>
+#include <learnopengl/transform.h>
 #include <learnopengl/animdata.h>
 #include <learnopengl/model_animation.h>
 
-struct BoneNodeData
-{
-	glm::mat4 transformation;
-	std::string name;
-	std::vector<BoneNodeData> children;
-};
-
-
-
 class Animation
 {
 public:
 	Animation() = default;
 
-	Animation(const std::string& animationPath, Model* model)
+	Animation(const std::string& animationPath, Model* model,
+		const ClipCompressionSettings& compression = ClipCompressionSettings())
 	{
 		Assimp::Importer importer;
 		const aiScene* scene = importer.ReadFile(animationPath, aiProcess_Triangulate);
-		assert(scene && scene->mRootNode);
-		auto animation = scene->mAnimations[0];
-		m_Duration = animation->mDuration;
-		m_TicksPerSecond = animation->mTicksPerSecond;
+		assert(scene && scene->mRootNode && scene->mNumAnimations > 0);
 		std::cout << "Animation number: " << scene->mNumAnimations << std::endl;
-		std::cout << "Animation Duration: " << m_Duration << std::endl;
-		std::cout << "Animation TicksPerSecond  " << m_TicksPerSecond << std::endl;
-		aiMatrix4x4 globalTransformation = scene->mRootNode->mTransformation;
-		globalTransformation = globalTransformation.Inverse();
-		ReadMissingBones(animation, *model);
-		ReadHierarchyData(m_RootNode, scene->mRootNode);
+		Init(scene->mAnimations[0], model, compression);
+	}
+
+	// builds the animation from an already imported clip, see ClipLibrary
+	Animation(const aiAnimation* animation, Model* model,
+		const ClipCompressionSettings& compression = ClipCompressionSettings())
+	{
+		Init(animation, model, compression);
+	}
+
+	// wraps a clip that is already compressed and bound, e.g. read from a cooked file
+	Animation(std::shared_ptr<AnimationClip> clip, std::shared_ptr<const Skeleton> skeleton, const int32_t* trackJoints)
+	{
+		m_Clip = std::move(clip);
+		m_Duration = m_Clip->GetDuration();
+		m_TicksPerSecond = m_Clip->GetTicksPerSecond();
+		m_Skeleton = std::move(skeleton);
+		m_TrackJoints.assign(trackJoints, trackJoints + m_Clip->GetNumTracks());
+		CreateBones();
+		InitSampler();
 	}
 
 	~Animation()
@@ -57,72 +66,162 @@ public:
 	}
 
 
-	inline float GetTicksPerSecond() { return m_TicksPerSecond; }
-	inline float GetDuration() { return m_Duration; }
-	inline const BoneNodeData& GetRootNode() { return m_RootNode; }
-	inline const std::map<std::string, BoneInfo>& GetBoneIDMap()
+	// samples every track at once in clip order, the pose of m_Bones[i] ends up in GetTrackPoses()[i]
+	void SampleBones(float animationTime)
 	{
-		return m_BoneInfoMap;
+		m_Sampler.Sample(animationTime, m_TrackPoses.data());
 	}
 
+	inline const std::vector<Bone>& GetBones() { return m_Bones; }
+	inline const std::vector<Transform>& GetTrackPoses() { return m_TrackPoses; }
+	inline float GetTicksPerSecond() { return m_TicksPerSecond; }
+	inline float GetDuration() { return m_Duration; }
+	inline const AnimationClip& GetClip() { return *m_Clip; }
+	inline const Skeleton& GetSkeleton() { return *m_Skeleton; }
+	// skeleton joint each clip track animates, -1 for tracks of nodes the skeleton doesn't have
+	inline const std::vector<int>& GetTrackJoints() { return m_TrackJoints; }
+
 private:
-	void ReadMissingBones(const aiAnimation* animation, Model& model)
+	void Init(const aiAnimation* animation, Model* model, const ClipCompressionSettings& compression)
 	{
-		int size = animation->mNumChannels;
+		m_Duration = animation->mDuration;
+		m_TicksPerSecond = animation->mTicksPerSecond;
+		std::cout << "Animation Name: " << animation->mName.C_Str() << std::endl;
+		std::cout << "Animation Duration: " << m_Duration << std::endl;
+		std::cout << "Animation TicksPerSecond  " << m_TicksPerSecond << std::endl;
+		m_Clip = std::make_shared<AnimationClip>(animation);
+		std::cout << "Animation Clip Size: " << m_Clip->GetSizeInBytes() << " bytes" << std::endl;
+		BindTracks(model->GetSkeleton());
+		if (compression.enabled)
+			CompressClip(compression, *model);
+		InitSampler();
+	}
 
-		auto& boneInfoMap = model.GetBoneInfoMap();//getting m_BoneInfoMap from Model class
-		int& boneCount = model.GetBoneCount(); //getting the m_BoneCounter from Model class
+	void InitSampler()
+	{
+		m_Sampler = ClipSampler(m_Clip.get());
+		m_TrackPoses.resize(m_Clip->GetNumTracks());
+		std::cout << "Animation Sampler: " << GetSamplerISAName(m_Sampler.GetISA()) << std::endl;
+	}
 
-		//reading channels(bones engaged in an animation and their keyframes)
+	// binds the clip to the rig's skeleton by track name, the skeleton itself is shared and never modified
+	void BindTracks(const std::shared_ptr<const Skeleton>& skeleton)
+	{
+		m_Skeleton = skeleton;
+		int size = m_Clip->GetNumTracks();
+		m_TrackJoints.resize(size);
 		for (int i = 0; i < size; i++)
 		{
-			auto channel = animation->mChannels[i];
-			std::string boneName = channel->mNodeName.data;
-
-			if (boneInfoMap.find(boneName) == boneInfoMap.end())
-			{
-				boneInfoMap[boneName].id = boneCount;
-				boneCount++;
-			}
-			m_Bones.push_back(Bone(channel->mNodeName.data,
-				boneInfoMap[channel->mNodeName.data].id, channel));
+			int joint = m_Skeleton->FindJoint(m_Clip->GetTrackName(i));
+			if (joint < 0)
+				std::cout << "Animation track " << m_Clip->GetTrackName(i) << " has no joint in the skeleton" << std::endl;
+			m_TrackJoints[i] = joint;
 		}
+		CreateBones();
+	}
 
-		m_BoneInfoMap = boneInfoMap;
+	//reading channels(bones engaged in an animation), their keyframes stay in the clip
+	void CreateBones()
+	{
+		const std::vector<int>& boneIDs = m_Skeleton->GetBoneIDs();
+		m_Bones.clear();
+		m_Bones.reserve(m_TrackJoints.size());
+		for (int i = 0; i < static_cast<int>(m_TrackJoints.size()); i++)
+			m_Bones.push_back(Bone(m_Clip.get(), i, m_TrackJoints[i] >= 0 ? boneIDs[m_TrackJoints[i]] : -1));
 	}
 
-	void ReadHierarchyData(BoneNodeData& dest, const aiNode* src)
+	// replaces the full precision clip by its compressed version, measuring the error on the model's skinned vertices
+	void CompressClip(const ClipCompressionSettings& settings, const Model& model)
 	{
-		assert(src);
+		ClipCompressionStats stats;
+		std::shared_ptr<AnimationClip> compressed = ClipCompressor(settings).Compress(*m_Clip, stats);
 
-		bool isBone = false;
-		std::string NodeName(src->mName.data);
-		if (m_BoneInfoMap.find(NodeName) != m_BoneInfoMap.end())    // if the node corresponds to a bone/skeletal joint
-		{
-			dest.name = src->mName.data;
-			dest.transformation = AssimpGLMHelpers::ConvertMatrixToGLMFormat(src->mTransformation);
-			isBone = true;
-		}
-		for (int i = 0; i < src->mNumChildren; i++)
+		std::vector<Bone> compressedBones;
+		compressedBones.reserve(m_Bones.size());
+		for (int i = 0; i < static_cast<int>(m_Bones.size()); i++)
+			compressedBones.push_back(Bone(compressed.get(), i, m_Bones[i].GetBoneID()));
+
+		stats.maxError = MeasureSkinnedError(m_Bones, compressedBones, model);
+		std::cout << "Animation Compression: " << stats.rawSize << " -> " << stats.compressedSize << " bytes (ratio "
+			<< stats.GetRatio() << ":1), keys " << stats.rawKeys << " -> " << stats.keptKeys << ", " << stats.floatChannels << " float channels"
+			<< ", max skinned vertex error " << stats.maxError << std::endl;
+
+		m_Clip = compressed;
+		m_Bones = compressedBones;
+	}
+
+	// largest distance between the model's vertices skinned by the two bone sets, over samples spread across the clip
+	float MeasureSkinnedError(std::vector<Bone>& reference, std::vector<Bone>& bones, const Model& model)
+	{
+		const int MaxSamples = 128;
+		int numSamples = std::max(2, std::min(MaxSamples, static_cast<int>(m_Duration) + 1));
+		int numPalette = m_Skeleton->GetPaletteSize();
+
+		std::vector<Transform> referencePoses = m_Skeleton->GetBindPoses();
+		std::vector<Transform> poses = m_Skeleton->GetBindPoses();
+		std::vector<glm::mat4x3> modelTransforms;
+		std::vector<glm::mat4x3> referencePalette(numPalette, glm::mat4x3(1.0f));
+		std::vector<glm::mat4x3> palette(numPalette, glm::mat4x3(1.0f));
+		float maxError = 0.0f;
+		for (int sample = 0; sample < numSamples; sample++)
 		{
-			if (isBone) {
-				BoneNodeData newData;
-				ReadHierarchyData(newData, src->mChildren[i]);
-				if (newData.name != "") {
-					dest.children.push_back(newData);     //adding the bone to the hierarchy, if the bone is valid.
-				}
-				
+			float time = m_Duration * sample / (numSamples - 1);
+			for (size_t i = 0; i < m_TrackJoints.size(); i++)
+			{
+				int joint = m_TrackJoints[i];
+				if (joint < 0)
+					continue;
+				reference[i].Update(time);
+				bones[i].Update(time);
+				referencePoses[joint] = reference[i].GetLocalPose();
+				poses[joint] = bones[i].GetLocalPose();
 			}
-			else {
-				ReadHierarchyData(dest, src->mChildren[i]);
+			CalculatePalette(referencePoses, modelTransforms, referencePalette);
+			CalculatePalette(poses, modelTransforms, palette);
+
+			for (const auto& mesh : model.GetMeshData())
+			{
+				const Vertex* vertices = mesh->GetVertices();
+				for (unsigned int v = 0; v < mesh->GetNumVertices(); v++)
+				{
+					const Vertex& vertex = vertices[v];
+					glm::vec4 position(vertex.Position, 1.0f);
+					glm::vec3 expected(0.0f), actual(0.0f);
+					for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+					{
+						int id = vertex.m_BoneIDs[i];
+						// a partitioned mesh's ids index its local palette
+						if (id >= 0 && !mesh->bones.empty())
+							id = mesh->bones[id];
+						if (id < 0 || id >= numPalette)
+							continue;
+						expected += (referencePalette[id] * position) * vertex.m_Weights[i];
+						actual += (palette[id] * position) * vertex.m_Weights[i];
+					}
+					maxError = std::max(maxError, glm::length(expected - actual));
+				}
 			}
-			
 		}
+		return maxError;
+	}
+
+	void CalculatePalette(const std::vector<Transform>& poses, std::vector<glm::mat4x3>& modelTransforms, std::vector<glm::mat4x3>& palette)
+	{
+		m_Skeleton->CalculateModelTransforms(poses, modelTransforms);
+		const std::vector<int>& boneIDs = m_Skeleton->GetBoneIDs();
+		const std::vector<glm::mat4x3>& offsets = m_Skeleton->GetOffsets();
+		for (int i = 0; i < m_Skeleton->GetNumJoints(); i++)
+			if (boneIDs[i] >= 0)
+				palette[boneIDs[i]] = MulAffine(modelTransforms[i], offsets[i]);
 	}
+
 	float m_Duration;
 	int m_TicksPerSecond;
+	std::shared_ptr<AnimationClip> m_Clip;
 	std::vector<Bone> m_Bones;
-	BoneNodeData m_RootNode;
-	std::map<std::string, BoneInfo> m_BoneInfoMap;
+	ClipSampler m_Sampler;
+	std::vector<Transform> m_TrackPoses;
+	std::shared_ptr<const Skeleton> m_Skeleton;
+	std::vector<int> m_TrackJoints;
 };
 
@@ -0,0 +1,345 @@
+#pragma once
+
+/* Keyframe storage for a whole clip in one contiguous allocation.
+   Key times are stored once per distinct timeline and shared by every channel keyed on it,
+   values live in packed arrays (positions and scales as vec3, rotations as quat) in track order.
+   Compressed channels keep their values as 16 bit triples instead, see clip_compression.h. */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <assimp/anim.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <learnopengl/assimp_glm_helpers.h>
+
+enum Clip_Channel {
+	CHANNEL_POSITION,
+	CHANNEL_ROTATION,
+	CHANNEL_SCALE,
+	NUM_CLIP_CHANNELS
+};
+
+enum Clip_Format {
+	FORMAT_FLOAT,		// vec3 or quat values
+	FORMAT_QUANTIZED	// three uint16 per key: fixed point in a range, or a smallest-three quaternion
+};
+
+struct ClipTimeline
+{
+	uint32_t firstTime;	// index of the first key time in the time array
+	uint32_t numKeys;
+};
+
+struct ClipChannel
+{
+	uint32_t timeline;
+	uint32_t firstKey;	// index of the first value in the vector, rotation or packed array
+	uint32_t format;
+	uint32_t range;		// range of a quantized vector channel
+};
+
+struct ClipTrack
+{
+	ClipChannel channels[NUM_CLIP_CHANNELS];
+	uint32_t nameOffset;	// null terminated string in the name table
+};
+
+struct ClipRange
+{
+	glm::vec3 min;
+	glm::vec3 extent;
+};
+
+struct ClipHeader
+{
+	float duration;
+	float ticksPerSecond;
+	uint32_t numTracks;
+	uint32_t numTimelines;
+	uint32_t numTimes;
+	uint32_t numVectors;
+	uint32_t numRotations;
+	uint32_t numRanges;
+	uint32_t numPacked;
+	uint32_t namesSize;
+
+	// byte offsets from the start of the clip
+	uint32_t tracksOffset;
+	uint32_t timelinesOffset;
+	uint32_t timesOffset;
+	uint32_t vectorsOffset;
+	uint32_t rotationsOffset;
+	uint32_t rangesOffset;
+	uint32_t packedOffset;
+	uint32_t namesOffset;
+	uint32_t totalSize;
+};
+
+// collects tracks and lays them out in the packed clip format
+class ClipBuilder
+{
+public:
+	ClipBuilder(float duration, float ticksPerSecond)
+		:
+		m_Duration(duration),
+		m_TicksPerSecond(ticksPerSecond)
+	{
+	}
+
+	int AddTrack(const char* name)
+	{
+		ClipTrack track = {};
+		track.nameOffset = static_cast<uint32_t>(m_Names.size());
+		m_Names.append(name);
+		m_Names.push_back('\0');
+		m_Tracks.push_back(track);
+		return static_cast<int>(m_Tracks.size()) - 1;
+	}
+
+	void SetVectorKeys(int track, Clip_Channel type, const float* times, const glm::vec3* values, int numKeys)
+	{
+		ClipChannel& channel = m_Tracks[track].channels[type];
+		channel.timeline = AddTimeline(times, numKeys);
+		channel.firstKey = static_cast<uint32_t>(m_Vectors.size());
+		channel.format = FORMAT_FLOAT;
+		channel.range = 0;
+		m_Vectors.insert(m_Vectors.end(), values, values + numKeys);
+	}
+
+	void SetRotationKeys(int track, const float* times, const glm::quat* values, int numKeys)
+	{
+		ClipChannel& channel = m_Tracks[track].channels[CHANNEL_ROTATION];
+		channel.timeline = AddTimeline(times, numKeys);
+		channel.firstKey = static_cast<uint32_t>(m_Rotations.size());
+		channel.format = FORMAT_FLOAT;
+		channel.range = 0;
+		m_Rotations.insert(m_Rotations.end(), values, values + numKeys);
+	}
+
+	// packed holds three uint16 per key; range is only used by position and scale channels
+	void SetQuantizedKeys(int track, Clip_Channel type, const float* times, const uint16_t* packed, int numKeys, const ClipRange& range)
+	{
+		ClipChannel& channel = m_Tracks[track].channels[type];
+		channel.timeline = AddTimeline(times, numKeys);
+		channel.firstKey = static_cast<uint32_t>(m_Packed.size() / 3);
+		channel.format = FORMAT_QUANTIZED;
+		channel.range = static_cast<uint32_t>(m_Ranges.size());
+		m_Ranges.push_back(range);
+		m_Packed.insert(m_Packed.end(), packed, packed + numKeys * 3);
+	}
+
+	std::unique_ptr<unsigned char[]> Build() const
+	{
+		ClipHeader header;
+		header.duration = m_Duration;
+		header.ticksPerSecond = m_TicksPerSecond;
+		header.numTracks = static_cast<uint32_t>(m_Tracks.size());
+		header.numTimelines = static_cast<uint32_t>(m_Timelines.size());
+		header.numTimes = static_cast<uint32_t>(m_Times.size());
+		header.numVectors = static_cast<uint32_t>(m_Vectors.size());
+		header.numRotations = static_cast<uint32_t>(m_Rotations.size());
+		header.numRanges = static_cast<uint32_t>(m_Ranges.size());
+		header.numPacked = static_cast<uint32_t>(m_Packed.size() / 3);
+		header.namesSize = static_cast<uint32_t>(m_Names.size());
+
+		uint32_t size = Align(sizeof(ClipHeader));
+		header.tracksOffset = size;		size = Align(size + header.numTracks * sizeof(ClipTrack));
+		header.timelinesOffset = size;	size = Align(size + header.numTimelines * sizeof(ClipTimeline));
+		header.timesOffset = size;		size = Align(size + header.numTimes * sizeof(float));
+		header.vectorsOffset = size;	size = Align(size + header.numVectors * sizeof(glm::vec3));
+		header.rotationsOffset = size;	size = Align(size + header.numRotations * sizeof(glm::quat));
+		header.rangesOffset = size;		size = Align(size + header.numRanges * sizeof(ClipRange));
+		header.packedOffset = size;		size = Align(size + header.numPacked * 3 * sizeof(uint16_t));
+		header.namesOffset = size;		size = Align(size + header.namesSize);
+		header.totalSize = size;
+
+		std::unique_ptr<unsigned char[]> storage(new unsigned char[size]());
+		unsigned char* data = storage.get();
+		std::memcpy(data, &header, sizeof(ClipHeader));
+		std::memcpy(data + header.tracksOffset, m_Tracks.data(), m_Tracks.size() * sizeof(ClipTrack));
+		std::memcpy(data + header.timelinesOffset, m_Timelines.data(), m_Timelines.size() * sizeof(ClipTimeline));
+		std::memcpy(data + header.timesOffset, m_Times.data(), m_Times.size() * sizeof(float));
+		std::memcpy(data + header.vectorsOffset, m_Vectors.data(), m_Vectors.size() * sizeof(glm::vec3));
+		std::memcpy(data + header.rotationsOffset, m_Rotations.data(), m_Rotations.size() * sizeof(glm::quat));
+		std::memcpy(data + header.rangesOffset, m_Ranges.data(), m_Ranges.size() * sizeof(ClipRange));
+		std::memcpy(data + header.packedOffset, m_Packed.data(), m_Packed.size() * sizeof(uint16_t));
+		std::memcpy(data + header.namesOffset, m_Names.data(), m_Names.size());
+		return storage;
+	}
+
+private:
+	static uint32_t Align(size_t size)
+	{
+		return static_cast<uint32_t>((size + 15) & ~size_t(15));
+	}
+
+	// channels keyed at identical times share one timeline
+	uint32_t AddTimeline(const float* times, int numKeys)
+	{
+		std::vector<float> keyTimes(times, times + numKeys);
+		auto iter = m_TimelineLookup.find(keyTimes);
+		if (iter != m_TimelineLookup.end())
+			return iter->second;
+
+		ClipTimeline timeline;
+		timeline.firstTime = static_cast<uint32_t>(m_Times.size());
+		timeline.numKeys = static_cast<uint32_t>(numKeys);
+		m_Times.insert(m_Times.end(), keyTimes.begin(), keyTimes.end());
+
+		uint32_t index = static_cast<uint32_t>(m_Timelines.size());
+		m_Timelines.push_back(timeline);
+		m_TimelineLookup[keyTimes] = index;
+		return index;
+	}
+
+	float m_Duration;
+	float m_TicksPerSecond;
+	std::vector<ClipTrack> m_Tracks;
+	std::vector<ClipTimeline> m_Timelines;
+	std::map<std::vector<float>, uint32_t> m_TimelineLookup;
+	std::vector<float> m_Times;
+	std::vector<glm::vec3> m_Vectors;
+	std::vector<glm::quat> m_Rotations;
+	std::vector<ClipRange> m_Ranges;
+	std::vector<uint16_t> m_Packed;
+	std::string m_Names;
+};
+
+class AnimationClip
+{
+public:
+	AnimationClip(const aiAnimation* animation)
+		:
+		AnimationClip(BuildFromAssimp(animation))
+	{
+	}
+
+	AnimationClip(std::unique_ptr<unsigned char[]> storage)
+		:
+		m_Storage(std::move(storage)),
+		m_Data(m_Storage.get())
+	{
+	}
+
+	// view of a clip built elsewhere, e.g. in a mapped cooked file; owner keeps that memory alive
+	AnimationClip(const unsigned char* data, std::shared_ptr<const void> owner)
+		:
+		m_Owner(std::move(owner)),
+		m_Data(data)
+	{
+	}
+
+	AnimationClip(const AnimationClip&) = delete;
+	AnimationClip& operator=(const AnimationClip&) = delete;
+
+	inline const ClipHeader& GetHeader() const { return *reinterpret_cast<const ClipHeader*>(m_Data); }
+	inline float GetDuration() const { return GetHeader().duration; }
+	inline float GetTicksPerSecond() const { return GetHeader().ticksPerSecond; }
+	inline int GetNumTracks() const { return static_cast<int>(GetHeader().numTracks); }
+	inline size_t GetSizeInBytes() const { return GetHeader().totalSize; }
+
+	inline const ClipTrack& GetTrack(int track) const { return At<ClipTrack>(GetHeader().tracksOffset)[track]; }
+	inline const char* GetTrackName(int track) const { return At<char>(GetHeader().namesOffset) + GetTrack(track).nameOffset; }
+	inline const ClipTimeline& GetTimeline(const ClipChannel& channel) const { return At<ClipTimeline>(GetHeader().timelinesOffset)[channel.timeline]; }
+	inline const float* GetTimes(const ClipTimeline& timeline) const { return At<float>(GetHeader().timesOffset) + timeline.firstTime; }
+
+	// decodes one key of a position or scale channel
+	inline glm::vec3 GetVector(const ClipChannel& channel, int key) const
+	{
+		if (channel.format == FORMAT_FLOAT)
+			return At<glm::vec3>(GetHeader().vectorsOffset)[channel.firstKey + key];
+
+		const uint16_t* packed = At<uint16_t>(GetHeader().packedOffset) + (channel.firstKey + key) * 3;
+		const ClipRange& range = At<ClipRange>(GetHeader().rangesOffset)[channel.range];
+		return DecodeFixedPoint(packed, range);
+	}
+
+	// decodes one key of a rotation channel
+	inline glm::quat GetRotation(const ClipChannel& channel, int key) const
+	{
+		if (channel.format == FORMAT_FLOAT)
+			return At<glm::quat>(GetHeader().rotationsOffset)[channel.firstKey + key];
+
+		const uint16_t* packed = At<uint16_t>(GetHeader().packedOffset) + (channel.firstKey + key) * 3;
+		return DecodeSmallestThree(packed);
+	}
+
+	static inline glm::vec3 DecodeFixedPoint(const uint16_t* packed, const ClipRange& range)
+	{
+		const float scale = 1.0f / 65535.0f;
+		return range.min + range.extent * glm::vec3(packed[0], packed[1], packed[2]) * scale;
+	}
+
+	// the two top bits of packed[0] and packed[1] hold the index of the dropped (largest) component,
+	// the low 15 bits of each word the remaining components mapped from [-1/sqrt(2), 1/sqrt(2)]
+	static inline glm::quat DecodeSmallestThree(const uint16_t* packed)
+	{
+		const float range = 0.70710678f;
+		const float scale = 2.0f * range / 32767.0f;
+		int largest = (packed[0] >> 15) | ((packed[1] >> 15) << 1);
+		float a = (packed[0] & 0x7FFF) * scale - range;
+		float b = (packed[1] & 0x7FFF) * scale - range;
+		float c = (packed[2] & 0x7FFF) * scale - range;
+		float d = std::sqrt(std::max(0.0f, 1.0f - a * a - b * b - c * c));
+
+		// components in x, y, z, w order
+		float q[4];
+		int next = 0;
+		float small[3] = { a, b, c };
+		for (int i = 0; i < 4; i++)
+			q[i] = (i == largest) ? d : small[next++];
+		return glm::quat(q[3], q[0], q[1], q[2]);
+	}
+
+private:
+	template<typename T>
+	inline const T* At(uint32_t offset) const { return reinterpret_cast<const T*>(m_Data + offset); }
+
+	template<typename Key>
+	static std::vector<float> GetKeyTimes(const Key* keys, unsigned int numKeys)
+	{
+		std::vector<float> times(numKeys);
+		for (unsigned int i = 0; i < numKeys; i++)
+			times[i] = static_cast<float>(keys[i].mTime);
+		return times;
+	}
+
+	static std::unique_ptr<unsigned char[]> BuildFromAssimp(const aiAnimation* animation)
+	{
+		ClipBuilder builder(static_cast<float>(animation->mDuration), static_cast<float>(animation->mTicksPerSecond));
+		for (unsigned int i = 0; i < animation->mNumChannels; i++)
+		{
+			const aiNodeAnim* channel = animation->mChannels[i];
+			int track = builder.AddTrack(channel->mNodeName.C_Str());
+
+			std::vector<glm::vec3> positions(channel->mNumPositionKeys);
+			for (unsigned int key = 0; key < channel->mNumPositionKeys; key++)
+				positions[key] = AssimpGLMHelpers::GetGLMVec(channel->mPositionKeys[key].mValue);
+			builder.SetVectorKeys(track, CHANNEL_POSITION, GetKeyTimes(channel->mPositionKeys, channel->mNumPositionKeys).data(),
+				positions.data(), channel->mNumPositionKeys);
+
+			std::vector<glm::quat> rotations(channel->mNumRotationKeys);
+			for (unsigned int key = 0; key < channel->mNumRotationKeys; key++)
+				rotations[key] = AssimpGLMHelpers::GetGLMQuat(channel->mRotationKeys[key].mValue);
+			builder.SetRotationKeys(track, GetKeyTimes(channel->mRotationKeys, channel->mNumRotationKeys).data(),
+				rotations.data(), channel->mNumRotationKeys);
+
+			std::vector<glm::vec3> scales(channel->mNumScalingKeys);
+			for (unsigned int key = 0; key < channel->mNumScalingKeys; key++)
+				scales[key] = AssimpGLMHelpers::GetGLMVec(channel->mScalingKeys[key].mValue);
+			builder.SetVectorKeys(track, CHANNEL_SCALE, GetKeyTimes(channel->mScalingKeys, channel->mNumScalingKeys).data(),
+				scales.data(), channel->mNumScalingKeys);
+		}
+		return builder.Build();
+	}
+
+	std::unique_ptr<unsigned char[]> m_Storage;
+	std::shared_ptr<const void> m_Owner;
+	const unsigned char* m_Data;
+};
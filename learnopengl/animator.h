@@ -7,6 +7,9 @@
 #include <assimp/Importer.hpp>
 #include <learnopengl/animation.h>
 #include <learnopengl/bone.h>
+#include <learnopengl/dual_quaternion.h>
+#include <learnopengl/skeleton.h>
+#include <learnopengl/transform.h>
 #include <GLFW/glfw3.h>
 
 GLenum glCheckError_(const char* file, int line)
@@ -42,34 +45,31 @@ public:
 		InitAnim();
 	}
 
-	void ScanSkeleton(const BoneNodeData* node, const BoneNodeData* parent)
+	void ScanSkeleton()
 	{
-		std::string nodeName = node->name;
-		std::string parentName = parent? parent->name : "";
-
-		auto boneInfoMap = m_CurrentAnimation->GetBoneIDMap();
-		if (boneInfoMap.find(nodeName) != boneInfoMap.end() && boneInfoMap.find(parentName) != boneInfoMap.end())
+		const Skeleton& skeleton = m_CurrentAnimation->GetSkeleton();
+		const std::vector<int>& parents = skeleton.GetParents();
+		const std::vector<int>& boneIDs = skeleton.GetBoneIDs();
+		m_BoneLink.clear();
+		for (int i = 0; i < skeleton.GetNumJoints(); i++)
 		{
-			int index = boneInfoMap[nodeName].id;
-			int parentIndex = boneInfoMap[parentName].id;
-			m_BoneLink.push_back(parentIndex);
-			m_BoneLink.push_back(index);
-
+			if (parents[i] < 0 || boneIDs[i] < 0 || boneIDs[parents[i]] < 0)
+				continue;
+			m_BoneLink.push_back(boneIDs[parents[i]]);
+			m_BoneLink.push_back(boneIDs[i]);
 		}
-		for (int i = 0; i < node->children.size(); i++)
-			ScanSkeleton(&node->children[i], node);
-
 	}
 
 	void InitAnim()
 	{
-		m_FinalBoneMatrices.reserve(100);
-		m_BonePositions.reserve(100);
-		for (int i = 0; i < 100; i++) {
-			m_FinalBoneMatrices.push_back(glm::mat4(1.0f));
-			m_BonePositions.push_back(glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-		}
-		ScanSkeleton(&m_CurrentAnimation->GetRootNode(), nullptr);
+		// one entry per bone of the rig, however many it has
+		int paletteSize = m_CurrentAnimation->GetSkeleton().GetPaletteSize();
+		m_FinalBoneMatrices.assign(paletteSize, glm::mat4(1.0f));
+		m_FinalBoneDualQuats.assign(paletteSize, glm::dualquat(glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.0f)));
+		m_BonePositions.assign(paletteSize, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+		// joints the clip doesn't animate keep their bind pose
+		m_LocalPoses = m_CurrentAnimation->GetSkeleton().GetBindPoses();
+		ScanSkeleton();
 		glGenVertexArrays(1, &VAO);
 		glGenBuffers(1, &VBO);
 		glGenBuffers(1, &EBO);
@@ -83,7 +83,35 @@ public:
 		{
 			m_CurrentTime += m_CurrentAnimation->GetTicksPerSecond() * dt;
 			m_CurrentTime = fmod(m_CurrentTime, m_CurrentAnimation->GetDuration());
-			CalculateBoneTransform(&m_CurrentAnimation->GetRootNode(), glm::mat4(1.0f));
+			m_CurrentAnimation->SampleBones(m_CurrentTime);
+			const std::vector<int>& trackJoints = m_CurrentAnimation->GetTrackJoints();
+			const std::vector<Transform>& trackPoses = m_CurrentAnimation->GetTrackPoses();
+			for (size_t i = 0; i < trackJoints.size(); i++)
+			{
+				if (trackJoints[i] >= 0)
+					m_LocalPoses[trackJoints[i]] = trackPoses[i];
+			}
+			ApplyPose(m_LocalPoses, m_FinalBoneMatrices, m_BonePositions);
+			if (m_DualQuatOutput)
+				UpdateDualQuats();
+		}
+	}
+
+	// runs the hierarchy pass for local poses indexed by joint, writing the skinning palette and joint positions by bone id
+	void ApplyPose(const std::vector<Transform>& localPoses, std::vector<glm::mat4>& finalMatrices, std::vector<glm::vec4>& positions)
+	{
+		const Skeleton& skeleton = m_CurrentAnimation->GetSkeleton();
+		skeleton.CalculateModelTransforms(localPoses, m_ModelTransforms);
+
+		const std::vector<int>& boneIDs = skeleton.GetBoneIDs();
+		const std::vector<glm::mat4x3>& offsets = skeleton.GetOffsets();
+		for (int i = 0; i < skeleton.GetNumJoints(); i++)
+		{
+			int index = boneIDs[i];
+			if (index < 0 || index >= static_cast<int>(finalMatrices.size()))
+				continue;
+			finalMatrices[index] = ToMat4(MulAffine(m_ModelTransforms[i], offsets[i]));
+			positions[index] = glm::vec4(m_ModelTransforms[i][3], 1.0f);
 		}
 	}
 
@@ -94,32 +122,9 @@ public:
 		InitAnim();
 	}
 
-	void CalculateBoneTransform(const BoneNodeData* node, glm::mat4 parentTransform)
+	const std::vector<Transform>& GetLocalPoses()
 	{
-		std::string nodeName = node->name;
-		glm::mat4 nodeTransform = node->transformation;
-
-		Bone* Bone = m_CurrentAnimation->FindBone(nodeName);
-
-		if (Bone)
-		{
-			Bone->Update(m_CurrentTime);
-			nodeTransform = Bone->GetLocalTransform();
-		}
-
-		glm::mat4 globalTransformation = parentTransform * nodeTransform;
-
-		auto boneInfoMap = m_CurrentAnimation->GetBoneIDMap();
-		if (boneInfoMap.find(nodeName) != boneInfoMap.end())
-		{
-			int index = boneInfoMap[nodeName].id;
-			glm::mat4 offset = boneInfoMap[nodeName].offset;
-			m_FinalBoneMatrices[index] = globalTransformation * offset;
-			m_BonePositions[index] = globalTransformation * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
-		}
-
-		for (int i = 0; i < node->children.size(); i++)
-			CalculateBoneTransform(&node->children[i], globalTransformation);
+		return m_LocalPoses;
 	}
 
 	std::vector<glm::mat4> GetFinalBoneMatrices()
@@ -127,6 +132,19 @@ public:
 		return m_FinalBoneMatrices;
 	}
 
+	// also keep the palette as dual quaternions, for the DUAL_QUATERNION shader variants
+	void SetDualQuatOutput(bool enabled)
+	{
+		m_DualQuatOutput = enabled;
+		if (enabled)
+			UpdateDualQuats();
+	}
+
+	const std::vector<glm::dualquat>& GetFinalBoneDualQuats()
+	{
+		return m_FinalBoneDualQuats;
+	}
+
 	void DrawBones()
 	{
 		glClear(GL_DEPTH_BUFFER_BIT);
@@ -134,10 +152,10 @@ public:
 		glBindVertexArray(VAO);
 
 		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		glBufferData(GL_ARRAY_BUFFER, m_BonePositions.size()*sizeof(glm::vec4), &m_BonePositions[0], GL_STREAM_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, m_BonePositions.size()*sizeof(glm::vec4), m_BonePositions.data(), GL_STREAM_DRAW);
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER,  m_BoneLink.size()*sizeof(int), &m_BoneLink[0], GL_STREAM_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER,  m_BoneLink.size()*sizeof(int), m_BoneLink.data(), GL_STREAM_DRAW);
 
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
@@ -159,7 +177,17 @@ public:
 	}
 
 private:
+	void UpdateDualQuats()
+	{
+		for (size_t i = 0; i < m_FinalBoneMatrices.size(); i++)
+			m_FinalBoneDualQuats[i] = DualQuaternion::FromMatrix(m_FinalBoneMatrices[i]);
+	}
+
+	std::vector<Transform> m_LocalPoses;
+	std::vector<glm::mat4x3> m_ModelTransforms;
 	std::vector<glm::mat4> m_FinalBoneMatrices;
+	std::vector<glm::dualquat> m_FinalBoneDualQuats;
+	bool m_DualQuatOutput = false;
 	std::vector<glm::vec4> m_BonePositions;
 	std::vector<unsigned int> m_BoneLink;
 	Animation* m_CurrentAnimation;
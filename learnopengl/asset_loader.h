@@ -0,0 +1,142 @@
+#pragma once
+
+/* Streams models and their animations in while the render loop keeps drawing.
+   The Assimp import (or cooked file mapping), mesh processing, bone extraction and clip building run on a ThreadPool.
+   What needs the GL context goes through an UploadQueue that Update() drains a per-frame budget at a time. */
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <learnopengl/clip_library.h>
+#include <learnopengl/model_animation.h>
+#include <learnopengl/thread_pool.h>
+#include <learnopengl/upload_queue.h>
+
+struct LoadedModel
+{
+	std::shared_ptr<Model> model;
+	std::shared_ptr<ClipLibrary> clips;	// the model file's animations, then those of the extra animation files
+};
+
+class AssetLoader
+{
+public:
+	explicit AssetLoader(ThreadPool& pool)
+		:
+		m_Pool(pool)
+	{
+	}
+
+	// waits for loads still running on the pool, their uploads are dropped with the queue
+	~AssetLoader()
+	{
+		for (auto& load : m_Loads)
+			load->work.wait();
+	}
+
+	AssetLoader(const AssetLoader&) = delete;
+	AssetLoader& operator=(const AssetLoader&) = delete;
+
+	// loads path with the animations in it and in animationPaths bound to its skeleton, its meshes split by
+	// maxBonesPerDraw (see Model). The future becomes ready inside Update() once the meshes and textures are uploaded;
+	// a failed load leaves the model or clips empty, an exception on the loader thread is rethrown by the future
+	std::shared_future<std::shared_ptr<LoadedModel>> LoadModel(const std::string& path, const std::vector<std::string>& animationPaths = {},
+		int maxBonesPerDraw = 0)
+	{
+		auto load = std::make_shared<LoadState>();
+		std::shared_future<std::shared_ptr<LoadedModel>> future = load->result.get_future().share();
+		m_Loads.push_back(load);
+
+		LoadState* state = load.get();
+		load->work = m_Pool.Submit([this, state, path, animationPaths, maxBonesPerDraw]()
+		{
+			try
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				auto loaded = std::make_shared<LoadedModel>();
+				loaded->model = std::make_shared<Model>();
+				loaded->model->maxBonesPerDraw = maxBonesPerDraw;
+				loaded->clips = std::make_shared<ClipLibrary>();
+
+				// the mesh and its first animation come from the same file, which is imported at most once for both
+				ClipLibrary& clips = *loaded->clips;
+				loaded->model->Prepare(path, [&]() { return clips.Import(path); });
+				clips.Load(path, loaded->model.get());
+				for (const std::string& animationPath : animationPaths)
+					clips.Load(animationPath, loaded->model.get());
+				clips.ReleaseImport();
+
+				auto end = std::chrono::high_resolution_clock::now();
+				std::cout << "Prepared " << path << " on a loader thread: " << std::chrono::duration<double, std::milli>(end - start).count()
+					<< " ms" << std::endl;
+
+				std::vector<std::function<void()>> tasks = loaded->model->GetUploadTasks();
+				state->numUploads = static_cast<int>(tasks.size());
+				state->prepared = true;
+				for (auto& task : tasks)
+				{
+					m_Uploads.Push([state, task]()
+					{
+						task();
+						state->uploaded++;
+					});
+				}
+				m_Uploads.Push([state, loaded]() { state->result.set_value(loaded); });
+			}
+			catch (...)
+			{
+				// the future rethrows it, otherwise the load would never finish
+				state->prepared = true;
+				state->result.set_exception(std::current_exception());
+			}
+		});
+		return future;
+	}
+
+	// runs queued uploads for at most budgetMs on the context thread, once per frame. Returns the number run
+	int Update(double budgetMs)
+	{
+		return m_Uploads.Drain(budgetMs);
+	}
+
+	// 0 to 1 over every load started so far, preparing and uploading count half each
+	float GetProgress() const
+	{
+		if (m_Loads.empty())
+			return 1.0f;
+		float progress = 0.0f;
+		for (auto& load : m_Loads)
+		{
+			int numUploads = load->numUploads;
+			progress += load->prepared ? 0.5f : 0.0f;
+			progress += numUploads > 0 ? 0.5f * load->uploaded / numUploads : 0.0f;
+		}
+		return progress / m_Loads.size();
+	}
+
+	bool IsIdle() const
+	{
+		for (auto& load : m_Loads)
+			if (!load->prepared || load->uploaded < load->numUploads)
+				return false;
+		return m_Uploads.GetNumCompleted() == m_Uploads.GetNumPushed();
+	}
+
+private:
+	struct LoadState
+	{
+		std::promise<std::shared_ptr<LoadedModel>> result;
+		std::future<void> work;
+		std::atomic<bool> prepared{ false };
+		std::atomic<int> numUploads{ 0 };
+		std::atomic<int> uploaded{ 0 };
+	};
+
+	ThreadPool& m_Pool;
+	UploadQueue m_Uploads;
+	std::vector<std::shared_ptr<LoadState>> m_Loads;
+};
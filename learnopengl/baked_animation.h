@@ -0,0 +1,189 @@
+#pragma once
+
+/* Clips baked into bone palettes for crowds that don't need an Animator each. Bake() samples a clip at a fixed rate
+   on the CPU, no GL involved, into one texture row per frame holding every bone's skinning matrix as three RGBA32F
+   texels (the rows of its 3x4 affine part). The BAKED variant of anim_model.vs picks an instance's clip and time
+   from its instance attributes, fetches the two frames around it and blends them, so animating costs the CPU
+   nothing per frame past the time in the BakedClips block. */
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/animation.h>
+#include <learnopengl/clip_sampler.h>
+#include <learnopengl/skeleton.h>
+#include <learnopengl/transform.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// texture unit the baked palettes are bound to, next to the crowd's PaletteTextureUnit
+const GLuint BakedPaletteTextureUnit = 14;
+// binding point of the BakedClips block
+const GLuint BakedClipsBlockBinding = 2;
+// size of the clip table, MAX_BAKED_CLIPS in anim_model.vs
+const int MaxBakedClips = 32;
+
+struct BakedClipInfo
+{
+	std::string name;
+	int firstRow = 0;
+	int numFrames = 0;		// samples, the first at time 0 and the last at the clip's end
+	float duration = 0.0f;	// seconds
+};
+
+// layout(std140) uniform BakedClips
+struct BakedClipsBlock
+{
+	glm::vec4 clips[MaxBakedClips];	// first row, frames, duration in seconds, unused
+	float time;						// seconds, added to every instance's time offset
+	float padding[3];
+};
+
+class BakedAnimation
+{
+public:
+	// palettes of numBones bones, the skeleton's GetPaletteSize()
+	explicit BakedAnimation(int numBones)
+		:
+		m_NumBones(std::max(numBones, 1))
+	{
+	}
+
+	~BakedAnimation()
+	{
+		if (m_Texture)
+			glDeleteTextures(1, &m_Texture);
+		if (m_Block)
+			glDeleteBuffers(1, &m_Block);
+	}
+
+	BakedAnimation(const BakedAnimation&) = delete;
+	BakedAnimation& operator=(const BakedAnimation&) = delete;
+
+	// samples animation framesPerSecond times a second into new rows and returns its clip id, -1 once the table is
+	// full or for a clip without duration. Runs on the CPU only, Upload() hands the rows to GL
+	int Bake(Animation& animation, const std::string& name, float framesPerSecond = 30.0f)
+	{
+		if (GetNumClips() >= MaxBakedClips)
+		{
+			std::cout << "ERROR::BAKED_ANIMATION:: no room for clip " << name << ", the table holds " << MaxBakedClips << std::endl;
+			return -1;
+		}
+		const Skeleton& skeleton = animation.GetSkeleton();
+		const std::vector<int>& trackJoints = animation.GetTrackJoints();
+		const std::vector<int>& boneIDs = skeleton.GetBoneIDs();
+		const std::vector<glm::mat4x3>& offsets = skeleton.GetOffsets();
+		float ticksPerSecond = animation.GetTicksPerSecond() > 0.0f ? animation.GetTicksPerSecond() : 25.0f;
+		float duration = animation.GetDuration();
+
+		BakedClipInfo clip;
+		clip.name = name;
+		clip.firstRow = GetNumRows();
+		clip.duration = duration / ticksPerSecond;
+		// anim_model.vs wraps the time by the duration
+		if (!(clip.duration > 0.0f))
+		{
+			std::cout << "ERROR::BAKED_ANIMATION:: clip " << name << " has no duration" << std::endl;
+			return -1;
+		}
+		// whole intervals across the clip, so its last frame lands on the end and loops back onto the first
+		int intervals = std::max(1, static_cast<int>(std::ceil(clip.duration * framesPerSecond)));
+		clip.numFrames = intervals + 1;
+
+		ClipSampler sampler(&animation.GetClip());
+		std::vector<Transform> trackPoses(trackJoints.size());
+		std::vector<Transform> localPoses = skeleton.GetBindPoses();
+		std::vector<glm::mat4x3> modelTransforms;
+		size_t rowSize = static_cast<size_t>(m_NumBones) * 3;
+		m_Texels.resize(m_Texels.size() + clip.numFrames * rowSize);
+		for (int frame = 0; frame < clip.numFrames; frame++)
+		{
+			sampler.Sample(duration * frame / intervals, trackPoses.data());
+			for (size_t i = 0; i < trackJoints.size(); i++)
+				if (trackJoints[i] >= 0)
+					localPoses[trackJoints[i]] = trackPoses[i];
+			skeleton.CalculateModelTransforms(localPoses, modelTransforms);
+
+			glm::vec4* row = &m_Texels[(clip.firstRow + frame) * rowSize];
+			for (int bone = 0; bone < m_NumBones; bone++)
+				WriteRows(glm::mat4x3(1.0f), row + bone * 3);
+			for (int joint = 0; joint < skeleton.GetNumJoints(); joint++)
+				if (boneIDs[joint] >= 0 && boneIDs[joint] < m_NumBones)
+					WriteRows(MulAffine(modelTransforms[joint], offsets[joint]), row + boneIDs[joint] * 3);
+		}
+		m_Clips.push_back(clip);
+		return GetNumClips() - 1;
+	}
+
+	// creates the palette texture and the clip table from everything baked so far. Needs the GL context
+	bool Upload()
+	{
+		GLint maxSize = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+		if (m_NumBones * 3 > maxSize || GetNumRows() > maxSize)
+		{
+			std::cout << "ERROR::BAKED_ANIMATION:: " << m_NumBones * 3 << "x" << GetNumRows() << " texels exceed the texture size limit "
+				<< maxSize << std::endl;
+			return false;
+		}
+		if (!m_Texture)
+			glGenTextures(1, &m_Texture);
+		glBindTexture(GL_TEXTURE_2D, m_Texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_NumBones * 3, GetNumRows(), 0, GL_RGBA, GL_FLOAT, m_Texels.data());
+		// read with texelFetch only
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		for (int i = 0; i < GetNumClips(); i++)
+			m_ClipsBlock.clips[i] = glm::vec4(m_Clips[i].firstRow, m_Clips[i].numFrames, m_Clips[i].duration, 0.0f);
+		m_ClipsBlock.time = 0.0f;
+		if (!m_Block)
+			glGenBuffers(1, &m_Block);
+		glBindBuffer(GL_UNIFORM_BUFFER, m_Block);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(BakedClipsBlock), &m_ClipsBlock, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		return true;
+	}
+
+	// binds the palettes and the clip table for a frame at time seconds
+	void Bind(float time)
+	{
+		m_ClipsBlock.time = time;
+		glBindBuffer(GL_UNIFORM_BUFFER, m_Block);
+		glBufferSubData(GL_UNIFORM_BUFFER, offsetof(BakedClipsBlock, time), sizeof(float), &m_ClipsBlock.time);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glBindBufferBase(GL_UNIFORM_BUFFER, BakedClipsBlockBinding, m_Block);
+		glActiveTexture(GL_TEXTURE0 + BakedPaletteTextureUnit);
+		glBindTexture(GL_TEXTURE_2D, m_Texture);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	int GetNumBones() const { return m_NumBones; }
+	int GetNumClips() const { return static_cast<int>(m_Clips.size()); }
+	int GetNumRows() const { return static_cast<int>(m_Texels.size() / (static_cast<size_t>(m_NumBones) * 3)); }
+	const BakedClipInfo& GetClip(int clip) const { return m_Clips[clip]; }
+	// the baked rows, GetNumBones() * 3 texels each
+	const std::vector<glm::vec4>& GetTexels() const { return m_Texels; }
+	size_t GetSizeInBytes() const { return m_Texels.size() * sizeof(glm::vec4); }
+
+private:
+	static void WriteRows(const glm::mat4x3& m, glm::vec4* out)
+	{
+		for (int row = 0; row < 3; row++)
+			out[row] = glm::vec4(m[0][row], m[1][row], m[2][row], m[3][row]);
+	}
+
+	int m_NumBones;
+	std::vector<BakedClipInfo> m_Clips;
+	std::vector<glm::vec4> m_Texels;
+	BakedClipsBlock m_ClipsBlock = {};
+	GLuint m_Texture = 0;
+	GLuint m_Block = 0;
+};
@@ -1,6 +1,6 @@
 #pragma once
 
-/* Container for bone data */
+/* Playback state of one animated bone, sampling (and decompressing) its track in an AnimationClip */
 
 #include <vector>
 #include <assimp/scene.h>
@@ -9,115 +9,63 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/quaternion.hpp>
 #include <learnopengl/assimp_glm_helpers.h>
-
-struct KeyPosition
-{
-	glm::vec3 position;
-	float timeStamp;
-};
-
-struct KeyRotation
-{
-	glm::quat orientation;
-	float timeStamp;
-};
-
-struct KeyScale
-{
-	glm::vec3 scale;
-	float timeStamp;
-};
+#include <learnopengl/animation_clip.h>
+#include <learnopengl/keyframe_lookup.h>
+#include <learnopengl/transform.h>
 
 class Bone
 {
 public:
-	Bone(const std::string& name, int ID, const aiNodeAnim* channel)
+	Bone(const AnimationClip* clip, int track, int ID)
 		:
-		m_Name(name),
-		m_ID(ID),
-		m_LocalTransform(1.0f)
+		m_Clip(clip),
+		m_Track(track),
+		m_ID(ID)
 	{
-		m_NumPositions = channel->mNumPositionKeys;
-
-		for (int positionIndex = 0; positionIndex < m_NumPositions; ++positionIndex)
-		{
-			aiVector3D aiPosition = channel->mPositionKeys[positionIndex].mValue;
-			float timeStamp = channel->mPositionKeys[positionIndex].mTime;
-			KeyPosition data;
-			data.position = AssimpGLMHelpers::GetGLMVec(aiPosition);
-			data.timeStamp = timeStamp;
-			m_Positions.push_back(data);
-		}
-
-		m_NumRotations = channel->mNumRotationKeys;
-		for (int rotationIndex = 0; rotationIndex < m_NumRotations; ++rotationIndex)
-		{
-			aiQuaternion aiOrientation = channel->mRotationKeys[rotationIndex].mValue;
-			float timeStamp = channel->mRotationKeys[rotationIndex].mTime;
-			KeyRotation data;
-			data.orientation = AssimpGLMHelpers::GetGLMQuat(aiOrientation);
-			data.timeStamp = timeStamp;
-			m_Rotations.push_back(data);
-		}
-
-		m_NumScalings = channel->mNumScalingKeys;
-		for (int keyIndex = 0; keyIndex < m_NumScalings; ++keyIndex)
-		{
-			aiVector3D scale = channel->mScalingKeys[keyIndex].mValue;
-			float timeStamp = channel->mScalingKeys[keyIndex].mTime;
-			KeyScale data;
-			data.scale = AssimpGLMHelpers::GetGLMVec(scale);
-			data.timeStamp = timeStamp;
-			m_Scales.push_back(data);
-		}
 	}
 
 	void Update(float animationTime)
 	{
-		glm::mat4 translation = InterpolatePosition(animationTime);
-		glm::mat4 rotation = InterpolateRotation(animationTime);
-		glm::mat4 scale = InterpolateScaling(animationTime);
-		m_LocalTransform = translation * rotation * scale;
+		m_LocalPose.translation = InterpolatePosition(animationTime);
+		m_LocalPose.rotation = InterpolateRotation(animationTime);
+		m_LocalPose.scale = InterpolateScaling(animationTime);
 	}
-	glm::mat4 GetLocalTransform() { return m_LocalTransform; }
-	std::string GetBoneName() const { return m_Name; }
-	int GetBoneID() { return m_ID; }
+	const Transform& GetLocalPose() const { return m_LocalPose; }
+	glm::mat4 GetLocalTransform() const { return ToMat4(ComposeAffine(m_LocalPose)); }
+	const char* GetBoneName() const { return m_Clip->GetTrackName(m_Track); }
+	int GetBoneID() const { return m_ID; }
 
 
 
 	int GetPositionIndex(float animationTime)
 	{
-		for (int index = 0; index < m_NumPositions - 1; ++index)
-		{
-			if (animationTime < m_Positions[index + 1].timeStamp)
-				return index;
-		}
-		assert(0);
+		return GetKeyIndex(CHANNEL_POSITION, animationTime);
 	}
 
 	int GetRotationIndex(float animationTime)
 	{
-		for (int index = 0; index < m_NumRotations - 1; ++index)
-		{
-			if (animationTime < m_Rotations[index + 1].timeStamp)
-				return index;
-		}
-		assert(0);
+		return GetKeyIndex(CHANNEL_ROTATION, animationTime);
 	}
 
 	int GetScaleIndex(float animationTime)
 	{
-		for (int index = 0; index < m_NumScalings - 1; ++index)
-		{
-			if (animationTime < m_Scales[index + 1].timeStamp)
-				return index;
-		}
-		assert(0);
+		return GetKeyIndex(CHANNEL_SCALE, animationTime);
 	}
 
 
 private:
 
+	const ClipChannel& GetChannel(Clip_Channel type) const
+	{
+		return m_Clip->GetTrack(m_Track).channels[type];
+	}
+
+	int GetKeyIndex(Clip_Channel type, float animationTime)
+	{
+		const ClipTimeline& timeline = m_Clip->GetTimeline(GetChannel(type));
+		return FindKeyIndex(m_Clip->GetTimes(timeline), timeline.numKeys, animationTime, m_Cursors[type]);
+	}
+
 	float GetScaleFactor(float lastTimeStamp, float nextTimeStamp, float animationTime)
 	{
 		float scaleFactor = 0.0f;
@@ -127,61 +75,56 @@ private:
 		return scaleFactor;
 	}
 
-	glm::mat4 InterpolatePosition(float animationTime)
+	glm::vec3 InterpolatePosition(float animationTime)
 	{
-		if (1 == m_NumPositions)
-			return glm::translate(glm::mat4(1.0f), m_Positions[0].position);
+		const ClipChannel& channel = GetChannel(CHANNEL_POSITION);
+		const ClipTimeline& timeline = m_Clip->GetTimeline(channel);
+		if (1 == timeline.numKeys)
+			return m_Clip->GetVector(channel, 0);
 
+		const float* times = m_Clip->GetTimes(timeline);
 		int p0Index = GetPositionIndex(animationTime);
 		int p1Index = p0Index + 1;
-		float scaleFactor = GetScaleFactor(m_Positions[p0Index].timeStamp,
-			m_Positions[p1Index].timeStamp, animationTime);
-		glm::vec3 finalPosition = glm::mix(m_Positions[p0Index].position, m_Positions[p1Index].position
-			, scaleFactor);
-		return glm::translate(glm::mat4(1.0f), finalPosition);
+		float scaleFactor = GetScaleFactor(times[p0Index], times[p1Index], animationTime);
+		return glm::mix(m_Clip->GetVector(channel, p0Index), m_Clip->GetVector(channel, p1Index), scaleFactor);
 	}
 
-	glm::mat4 InterpolateRotation(float animationTime)
+	glm::quat InterpolateRotation(float animationTime)
 	{
-		if (1 == m_NumRotations)
-		{
-			auto rotation = glm::normalize(m_Rotations[0].orientation);
-			return glm::toMat4(rotation);
-		}
+		const ClipChannel& channel = GetChannel(CHANNEL_ROTATION);
+		const ClipTimeline& timeline = m_Clip->GetTimeline(channel);
+		if (1 == timeline.numKeys)
+			return glm::normalize(m_Clip->GetRotation(channel, 0));
 
+		const float* times = m_Clip->GetTimes(timeline);
 		int p0Index = GetRotationIndex(animationTime);
 		int p1Index = p0Index + 1;
-		float scaleFactor = GetScaleFactor(m_Rotations[p0Index].timeStamp,
-			m_Rotations[p1Index].timeStamp, animationTime);
-		glm::quat finalRotation = glm::slerp(m_Rotations[p0Index].orientation, m_Rotations[p1Index].orientation
-			, scaleFactor);
-		finalRotation = glm::normalize(finalRotation);
-		return glm::toMat4(finalRotation);
-
+		float scaleFactor = GetScaleFactor(times[p0Index], times[p1Index], animationTime);
+		glm::quat finalRotation = glm::slerp(m_Clip->GetRotation(channel, p0Index), m_Clip->GetRotation(channel, p1Index), scaleFactor);
+		return glm::normalize(finalRotation);
 	}
 
-	glm::mat4 InterpolateScaling(float animationTime)
+	glm::vec3 InterpolateScaling(float animationTime)
 	{
-		if (1 == m_NumScalings)
-			return glm::scale(glm::mat4(1.0f), m_Scales[0].scale);
+		const ClipChannel& channel = GetChannel(CHANNEL_SCALE);
+		const ClipTimeline& timeline = m_Clip->GetTimeline(channel);
+		if (1 == timeline.numKeys)
+			return m_Clip->GetVector(channel, 0);
 
+		const float* times = m_Clip->GetTimes(timeline);
 		int p0Index = GetScaleIndex(animationTime);
 		int p1Index = p0Index + 1;
-		float scaleFactor = GetScaleFactor(m_Scales[p0Index].timeStamp,
-			m_Scales[p1Index].timeStamp, animationTime);
-		glm::vec3 finalScale = glm::mix(m_Scales[p0Index].scale, m_Scales[p1Index].scale
-			, scaleFactor);
-		return glm::scale(glm::mat4(1.0f), finalScale);
+		float scaleFactor = GetScaleFactor(times[p0Index], times[p1Index], animationTime);
+		return glm::mix(m_Clip->GetVector(channel, p0Index), m_Clip->GetVector(channel, p1Index), scaleFactor);
 	}
 
-	std::vector<KeyPosition> m_Positions;
-	std::vector<KeyRotation> m_Rotations;
-	std::vector<KeyScale> m_Scales;
-	int m_NumPositions;
-	int m_NumRotations;
-	int m_NumScalings;
+	// the clip owns all key data, a Bone only keeps its track and playback state
+	const AnimationClip* m_Clip;
+	int m_Track;
+
+	// last key index found per channel, playback usually resumes from there
+	int m_Cursors[NUM_CLIP_CHANNELS] = { 0, 0, 0 };
 
-	glm::mat4 m_LocalTransform;
-	std::string m_Name;
+	Transform m_LocalPose;
 	int m_ID;
 };
@@ -0,0 +1,271 @@
+#pragma once
+
+/* Import-time compression of an AnimationClip.
+   Every channel is quantized (smallest-three rotations, range-reduced 16 bit fixed point positions
+   and scales), then keys that linear interpolation of the quantized neighbours reproduces within
+   the bone's tolerance are dropped. A position or scale channel whose range is too wide for 16 bits to hold within
+   tolerance keeps float keys instead. Decompression happens per key in AnimationClip::GetVector/GetRotation. */
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <learnopengl/animation_clip.h>
+
+struct ClipCompressionSettings
+{
+	bool enabled = true;
+
+	// largest error allowed at a virtual vertex, in model units
+	float tolerance = 0.01f;
+
+	// distance from the joint of the virtual vertex used to turn rotation and scale error into model units
+	float virtualVertexDistance = 10.0f;
+
+	// per-bone overrides of tolerance, by bone name
+	std::map<std::string, float> boneTolerances;
+};
+
+struct ClipCompressionStats
+{
+	size_t rawSize = 0;
+	size_t compressedSize = 0;
+	int rawKeys = 0;
+	int keptKeys = 0;
+	int floatChannels = 0;	// position and scale channels left unquantized, see CompressVectors
+
+	// largest distance between a vertex skinned with the raw and with the compressed clip
+	float maxError = 0.0f;
+
+	float GetRatio() const { return compressedSize ? float(rawSize) / float(compressedSize) : 0.0f; }
+};
+
+class ClipCompressor
+{
+public:
+	ClipCompressor(const ClipCompressionSettings& settings)
+		:
+		m_Settings(settings)
+	{
+	}
+
+	std::shared_ptr<AnimationClip> Compress(const AnimationClip& clip, ClipCompressionStats& stats) const
+	{
+		ClipBuilder builder(clip.GetDuration(), clip.GetTicksPerSecond());
+		for (int i = 0; i < clip.GetNumTracks(); i++)
+		{
+			int track = builder.AddTrack(clip.GetTrackName(i));
+			float tolerance = GetBoneTolerance(clip.GetTrackName(i));
+			CompressVectors(clip, i, CHANNEL_POSITION, tolerance, 1.0f, builder, track, stats);
+			CompressRotations(clip, i, tolerance, builder, track, stats);
+			CompressVectors(clip, i, CHANNEL_SCALE, tolerance, m_Settings.virtualVertexDistance, builder, track, stats);
+		}
+
+		auto compressed = std::make_shared<AnimationClip>(builder.Build());
+		stats.rawSize = clip.GetSizeInBytes();
+		stats.compressedSize = compressed->GetSizeInBytes();
+		return compressed;
+	}
+
+	static void EncodeFixedPoint(const glm::vec3& value, const ClipRange& range, uint16_t* packed)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			float normalized = range.extent[i] > 0.0f ? (value[i] - range.min[i]) / range.extent[i] : 0.0f;
+			packed[i] = static_cast<uint16_t>(std::lround(glm::clamp(normalized, 0.0f, 1.0f) * 65535.0f));
+		}
+	}
+
+	// drops the largest component (rebuilt from unit length on decode) after flipping the
+	// quaternion into the hemisphere where it is positive, see AnimationClip::DecodeSmallestThree
+	static void EncodeSmallestThree(const glm::quat& rotation, uint16_t* packed)
+	{
+		const float range = 0.70710678f;
+		glm::quat q = glm::normalize(rotation);
+		float components[4] = { q.x, q.y, q.z, q.w };
+
+		int largest = 0;
+		for (int i = 1; i < 4; i++)
+			if (std::fabs(components[i]) > std::fabs(components[largest]))
+				largest = i;
+		float sign = components[largest] < 0.0f ? -1.0f : 1.0f;
+
+		uint16_t small[3];
+		int next = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			if (i == largest)
+				continue;
+			float value = glm::clamp(components[i] * sign, -range, range);
+			small[next++] = static_cast<uint16_t>(std::lround((value + range) / (2.0f * range) * 32767.0f));
+		}
+		packed[0] = static_cast<uint16_t>(small[0] | ((largest & 1) << 15));
+		packed[1] = static_cast<uint16_t>(small[1] | ((largest >> 1) << 15));
+		packed[2] = small[2];
+	}
+
+private:
+	float GetBoneTolerance(const char* name) const
+	{
+		auto iter = m_Settings.boneTolerances.find(name);
+		return iter != m_Settings.boneTolerances.end() ? iter->second : m_Settings.tolerance;
+	}
+
+	// Greedy keyframe reduction: from each kept key, extend the segment as long as interpolating
+	// between its two end keys reproduces every key inside it within tolerance.
+	// error(a, b, k) is the error at key k when only a and b are kept.
+	template<typename ErrorFn>
+	static std::vector<int> ReduceKeys(int numKeys, float tolerance, ErrorFn error)
+	{
+		std::vector<int> kept;
+		kept.push_back(0);
+		if (numKeys == 1)
+			return kept;
+
+		bool constant = true;
+		for (int k = 1; k < numKeys && constant; k++)
+			constant = error(0, 0, k) <= tolerance;
+		if (constant)
+			return kept;
+
+		int start = 0;
+		while (start < numKeys - 1)
+		{
+			int end = start + 1;
+			while (end + 1 < numKeys)
+			{
+				bool reproducible = true;
+				for (int k = start + 1; k <= end && reproducible; k++)
+					reproducible = error(start, end + 1, k) <= tolerance;
+				if (!reproducible)
+					break;
+				++end;
+			}
+			kept.push_back(end);
+			start = end;
+		}
+		return kept;
+	}
+
+	static float GetFactor(const float* times, int a, int b, int k)
+	{
+		return b == a ? 0.0f : (times[k] - times[a]) / (times[b] - times[a]);
+	}
+
+	void CompressVectors(const AnimationClip& clip, int sourceTrack, Clip_Channel type, float tolerance, float errorScale,
+		ClipBuilder& builder, int track, ClipCompressionStats& stats) const
+	{
+		const ClipChannel& channel = clip.GetTrack(sourceTrack).channels[type];
+		const ClipTimeline& timeline = clip.GetTimeline(channel);
+		const float* times = clip.GetTimes(timeline);
+		int numKeys = static_cast<int>(timeline.numKeys);
+
+		std::vector<glm::vec3> values(numKeys);
+		glm::vec3 minValue(FLT_MAX), maxValue(-FLT_MAX);
+		for (int k = 0; k < numKeys; k++)
+		{
+			values[k] = clip.GetVector(channel, k);
+			minValue = glm::min(minValue, values[k]);
+			maxValue = glm::max(maxValue, values[k]);
+		}
+
+		ClipRange range;
+		range.min = minValue;
+		range.extent = maxValue - minValue;
+
+		std::vector<uint16_t> packed(numKeys * 3);
+		std::vector<glm::vec3> decoded(numKeys);
+		bool quantizable = true;
+		for (int k = 0; k < numKeys; k++)
+		{
+			EncodeFixedPoint(values[k], range, &packed[k * 3]);
+			decoded[k] = AnimationClip::DecodeFixedPoint(&packed[k * 3], range);
+			quantizable = quantizable && glm::length(decoded[k] - values[k]) * errorScale <= tolerance;
+		}
+		stats.rawKeys += numKeys;
+
+		// a kept key's own rounding would already break the tolerance, e.g. long root motion in large units
+		if (!quantizable)
+		{
+			std::vector<int> kept = ReduceKeys(numKeys, tolerance, [&](int a, int b, int k)
+			{
+				glm::vec3 value = glm::mix(values[a], values[b], GetFactor(times, a, b, k));
+				return glm::length(value - values[k]) * errorScale;
+			});
+			std::vector<float> keptTimes;
+			std::vector<glm::vec3> keptValues;
+			for (int k : kept)
+			{
+				keptTimes.push_back(times[k]);
+				keptValues.push_back(values[k]);
+			}
+			builder.SetVectorKeys(track, type, keptTimes.data(), keptValues.data(), static_cast<int>(kept.size()));
+			stats.keptKeys += static_cast<int>(kept.size());
+			stats.floatChannels++;
+			return;
+		}
+
+		std::vector<int> kept = ReduceKeys(numKeys, tolerance, [&](int a, int b, int k)
+		{
+			glm::vec3 value = glm::mix(decoded[a], decoded[b], GetFactor(times, a, b, k));
+			return glm::length(value - values[k]) * errorScale;
+		});
+
+		std::vector<float> keptTimes;
+		std::vector<uint16_t> keptPacked;
+		for (int k : kept)
+		{
+			keptTimes.push_back(times[k]);
+			keptPacked.insert(keptPacked.end(), &packed[k * 3], &packed[k * 3] + 3);
+		}
+		builder.SetQuantizedKeys(track, type, keptTimes.data(), keptPacked.data(), static_cast<int>(kept.size()), range);
+		stats.keptKeys += static_cast<int>(kept.size());
+	}
+
+	void CompressRotations(const AnimationClip& clip, int sourceTrack, float tolerance,
+		ClipBuilder& builder, int track, ClipCompressionStats& stats) const
+	{
+		const ClipChannel& channel = clip.GetTrack(sourceTrack).channels[CHANNEL_ROTATION];
+		const ClipTimeline& timeline = clip.GetTimeline(channel);
+		const float* times = clip.GetTimes(timeline);
+		int numKeys = static_cast<int>(timeline.numKeys);
+
+		std::vector<glm::quat> values(numKeys);
+		std::vector<uint16_t> packed(numKeys * 3);
+		std::vector<glm::quat> decoded(numKeys);
+		for (int k = 0; k < numKeys; k++)
+		{
+			values[k] = glm::normalize(clip.GetRotation(channel, k));
+			EncodeSmallestThree(values[k], &packed[k * 3]);
+			decoded[k] = AnimationClip::DecodeSmallestThree(&packed[k * 3]);
+		}
+
+		// angle between the rotations, measured as arc length at the virtual vertex
+		float distance = m_Settings.virtualVertexDistance;
+		std::vector<int> kept = ReduceKeys(numKeys, tolerance, [&](int a, int b, int k)
+		{
+			glm::quat value = glm::normalize(glm::slerp(decoded[a], decoded[b], GetFactor(times, a, b, k)));
+			float cosHalfAngle = std::min(1.0f, std::fabs(glm::dot(value, values[k])));
+			return 2.0f * std::acos(cosHalfAngle) * distance;
+		});
+
+		std::vector<float> keptTimes;
+		std::vector<uint16_t> keptPacked;
+		for (int k : kept)
+		{
+			keptTimes.push_back(times[k]);
+			keptPacked.insert(keptPacked.end(), &packed[k * 3], &packed[k * 3] + 3);
+		}
+		ClipRange unused = { glm::vec3(0.0f), glm::vec3(0.0f) };
+		builder.SetQuantizedKeys(track, CHANNEL_ROTATION, keptTimes.data(), keptPacked.data(), static_cast<int>(kept.size()), unused);
+		stats.rawKeys += numKeys;
+		stats.keptKeys += static_cast<int>(kept.size());
+	}
+
+	ClipCompressionSettings m_Settings;
+};
@@ -0,0 +1,190 @@
+#pragma once
+
+/* Named animations read with one Assimp import per file.
+   Import() keeps the scene alive until the next import, so the Model of a file that holds both the mesh
+   and its animations is built from the same scene before AddClips() extracts every aiAnimation in it.
+   Clips of a file with an up to date cooked file next to it (see cooked_animation.h) are mapped from there instead,
+   Cook() writes those files for everything loaded so far; clips to be cooked are read with LoadSource() so no
+   cooked file is still mapped while it is rewritten. */
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <learnopengl/animation.h>
+#include <learnopengl/cooked_animation.h>
+#include <learnopengl/model_animation.h>
+
+class ClipLibrary
+{
+public:
+	ClipLibrary(const ClipCompressionSettings& compression = ClipCompressionSettings())
+		:
+		m_Compression(compression)
+	{
+	}
+
+	ClipLibrary(const ClipLibrary&) = delete;
+	ClipLibrary& operator=(const ClipLibrary&) = delete;
+
+	// reads path with Model::ImportFlags, returns nullptr if the import failed
+	const aiScene* Import(const std::string& path)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		const aiScene* scene = m_Importer.ReadFile(path, Model::ImportFlags);
+		auto end = std::chrono::high_resolution_clock::now();
+		if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+		{
+			std::cout << "ERROR::ASSIMP:: " << m_Importer.GetErrorString() << std::endl;
+			m_Scene = nullptr;
+			return nullptr;
+		}
+		std::cout << "Import " << path << ": " << std::chrono::duration<double, std::milli>(end - start).count() << " ms, "
+			<< scene->mNumMeshes << " meshes, " << scene->mNumAnimations << " animations" << std::endl;
+		m_Scene = scene;
+		m_Path = path;
+		return scene;
+	}
+
+	// adds every animation of the last imported scene bound to model's skeleton, returns the number added
+	int AddClips(Model* model)
+	{
+		if (!m_Scene)
+			return 0;
+		int added = LoadCooked(m_Path, model);
+		return added >= 0 ? added : AddSceneClips(model);
+	}
+
+	// Import() and AddClips(), skipping the import when the cooked file is up to date or path is the last file imported
+	int Load(const std::string& path, Model* model)
+	{
+		int added = LoadCooked(path, model);
+		if (added >= 0)
+			return added;
+		if (m_Scene && m_Path == path)
+			return AddSceneClips(model);
+		return Import(path) ? AddSceneClips(model) : 0;
+	}
+
+	// Import() and AddClips() without looking for a cooked file, for clips that are going to be cooked
+	int LoadSource(const std::string& path, Model* model)
+	{
+		if (m_Scene && m_Path == path)
+			return AddSceneClips(model);
+		return Import(path) ? AddSceneClips(model) : 0;
+	}
+
+	// writes the cooked file of every source file clips were loaded from, returns the number written or up to date.
+	// Clips mapped from a cooked file still read it, that file is current and left alone
+	int Cook()
+	{
+		int written = 0;
+		for (const ClipSource& source : m_Sources)
+		{
+			if (source.mapped)
+			{
+				std::cout << "Cooked " << source.path << CookedAnimationExtension << ": up to date" << std::endl;
+				written++;
+				continue;
+			}
+			std::vector<CookedClipSource> clips;
+			for (int i = source.firstClip; i < source.firstClip + source.numClips; i++)
+				clips.push_back({ m_Names[i], &m_Clips[i]->GetClip(), &m_Clips[i]->GetTrackJoints() });
+
+			std::string path = source.path + CookedAnimationExtension;
+			if (WriteCookedAnimation(path, GetFileStamp(source.path), HashCompressionSettings(m_Compression), *source.skeleton, clips))
+			{
+				std::cout << "Cooked " << path << ": " << clips.size() << " clips" << std::endl;
+				written++;
+			}
+			else
+				std::cout << "ERROR::COOK:: could not write " << path << std::endl;
+		}
+		return written;
+	}
+
+	// frees the last imported scene, clips and models built from it don't reference it
+	void ReleaseImport()
+	{
+		m_Importer.FreeScene();
+		m_Scene = nullptr;
+	}
+
+	Animation* Get(const std::string& name)
+	{
+		for (size_t i = 0; i < m_Names.size(); i++)
+			if (m_Names[i] == name)
+				return m_Clips[i].get();
+		return nullptr;
+	}
+
+	Animation* Get(int index) { return index >= 0 && index < GetNumClips() ? m_Clips[index].get() : nullptr; }
+	int GetNumClips() const { return static_cast<int>(m_Clips.size()); }
+	const std::vector<std::string>& GetNames() const { return m_Names; }
+
+private:
+	// clips loaded from one file, in order
+	struct ClipSource
+	{
+		std::string path;
+		std::shared_ptr<const Skeleton> skeleton;
+		int firstClip;
+		int numClips;
+		bool mapped;	// the clips read the cooked file in place
+	};
+
+	int AddSceneClips(Model* model)
+	{
+		AddSource(m_Path, model->GetSkeleton(), false);
+		for (unsigned int i = 0; i < m_Scene->mNumAnimations; i++)
+		{
+			const aiAnimation* animation = m_Scene->mAnimations[i];
+			std::string name = animation->mName.length > 0 ? animation->mName.C_Str() : m_Path + "#" + std::to_string(i);
+			std::cout << "Animation: " << name << std::endl;
+			AddClip(name, std::unique_ptr<Animation>(new Animation(animation, model, m_Compression)));
+		}
+		return m_Scene->mNumAnimations;
+	}
+
+	// maps the cooked file of path, -1 if it is missing or stale
+	int LoadCooked(const std::string& path, Model* model)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		std::shared_ptr<const Skeleton> skeleton = model->GetSkeleton();
+		CookedAnimationFile file;
+		if (!file.Open(path + CookedAnimationExtension, GetFileStamp(path), HashCompressionSettings(m_Compression))
+			|| !file.MatchesSkeleton(*skeleton))
+			return -1;
+
+		AddSource(path, skeleton, true);
+		for (int i = 0; i < file.GetNumClips(); i++)
+			AddClip(file.GetClipName(i), std::unique_ptr<Animation>(new Animation(file.GetClip(i), skeleton, file.GetTrackJoints(i))));
+		auto end = std::chrono::high_resolution_clock::now();
+		std::cout << "Cooked " << path << CookedAnimationExtension << ": " << std::chrono::duration<double, std::micro>(end - start).count()
+			<< " us, " << file.GetNumClips() << " animations" << std::endl;
+		return file.GetNumClips();
+	}
+
+	void AddSource(const std::string& path, std::shared_ptr<const Skeleton> skeleton, bool mapped)
+	{
+		m_Sources.push_back({ path, std::move(skeleton), GetNumClips(), 0, mapped });
+	}
+
+	void AddClip(const std::string& name, std::unique_ptr<Animation> clip)
+	{
+		m_Names.push_back(name);
+		m_Clips.push_back(std::move(clip));
+		m_Sources.back().numClips++;
+	}
+
+	ClipCompressionSettings m_Compression;
+	Assimp::Importer m_Importer;
+	const aiScene* m_Scene = nullptr;
+	std::string m_Path;
+	std::vector<std::string> m_Names;
+	std::vector<std::unique_ptr<Animation>> m_Clips;	// Animators keep pointers, so clips never move
+	std::vector<ClipSource> m_Sources;
+};
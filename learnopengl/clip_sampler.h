@@ -0,0 +1,361 @@
+#pragma once
+
+/* Batched sampling of every track of a clip at one time.
+   Keys are looked up and decoded per channel into structure-of-arrays lanes, then interpolated
+   4 (SSE) or 8 (AVX) tracks per instruction. The instruction set is picked at runtime. */
+
+#include <cmath>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <learnopengl/animation_clip.h>
+#include <learnopengl/keyframe_lookup.h>
+#include <learnopengl/transform.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CLIP_SAMPLER_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define CLIP_SAMPLER_AVX_TARGET
+#else
+#include <cpuid.h>
+#define CLIP_SAMPLER_AVX_TARGET __attribute__((target("avx")))
+#endif
+#endif
+
+enum Sampler_ISA {
+	SAMPLER_SCALAR,
+	SAMPLER_SSE,
+	SAMPLER_AVX
+};
+
+inline const char* GetSamplerISAName(Sampler_ISA isa)
+{
+	switch (isa)
+	{
+	case SAMPLER_SSE: return "SSE";
+	case SAMPLER_AVX: return "AVX";
+	default: return "scalar";
+	}
+}
+
+// best instruction set supported by both the CPU and the OS
+inline Sampler_ISA DetectSamplerISA()
+{
+#if defined(CLIP_SAMPLER_X86)
+	unsigned int ecx, edx;
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	ecx = info[2];
+	edx = info[3];
+#else
+	unsigned int eax, ebx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return SAMPLER_SCALAR;
+#endif
+	bool sse2 = (edx & (1u << 26)) != 0;
+	bool osxsave = (ecx & (1u << 27)) != 0;
+	bool avx = (ecx & (1u << 28)) != 0;
+	if (avx && osxsave)
+	{
+		// the OS has to save the ymm registers too
+#if defined(_MSC_VER)
+		unsigned long long xcr0 = _xgetbv(0);
+#else
+		unsigned int xcr0Low, xcr0High;
+		__asm__ volatile("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+		unsigned long long xcr0 = xcr0Low;
+#endif
+		if ((xcr0 & 6) == 6)
+			return SAMPLER_AVX;
+	}
+	if (sse2)
+		return SAMPLER_SSE;
+#endif
+	return SAMPLER_SCALAR;
+}
+
+inline Sampler_ISA GetSamplerISA()
+{
+	static const Sampler_ISA isa = DetectSamplerISA();
+	return isa;
+}
+
+// out = a + (b - a) * t over count lanes
+inline void LerpLanesScalar(const float* a, const float* b, const float* t, float* out, int count)
+{
+	for (int i = 0; i < count; i++)
+		out[i] = a[i] + (b[i] - a[i]) * t[i];
+}
+
+// normalized lerp of quaternions (x, y, z, w arrays) with b flipped into the hemisphere of a,
+// absDot receives |dot(a, b)| so the caller can pick slerp where nlerp is too far off
+inline void NlerpLanesScalar(const float* const a[4], const float* const b[4], const float* t, float* const out[4], float* absDot, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		float dot = a[0][i] * b[0][i] + a[1][i] * b[1][i] + a[2][i] * b[2][i] + a[3][i] * b[3][i];
+		float sign = dot < 0.0f ? -1.0f : 1.0f;
+		float s = 1.0f - t[i];
+		float q[4], lengthSquared = 0.0f;
+		for (int c = 0; c < 4; c++)
+		{
+			q[c] = a[c][i] * s + b[c][i] * sign * t[i];
+			lengthSquared += q[c] * q[c];
+		}
+		float invLength = 1.0f / std::sqrt(lengthSquared);
+		for (int c = 0; c < 4; c++)
+			out[c][i] = q[c] * invLength;
+		absDot[i] = dot * sign;
+	}
+}
+
+#if defined(CLIP_SAMPLER_X86)
+inline void LerpLanesSSE(const float* a, const float* b, const float* t, float* out, int count)
+{
+	for (int i = 0; i < count; i += 4)
+	{
+		__m128 va = _mm_loadu_ps(a + i);
+		__m128 vb = _mm_loadu_ps(b + i);
+		__m128 vt = _mm_loadu_ps(t + i);
+		_mm_storeu_ps(out + i, _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(vb, va), vt)));
+	}
+}
+
+inline void NlerpLanesSSE(const float* const a[4], const float* const b[4], const float* t, float* const out[4], float* absDot, int count)
+{
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+	const __m128 one = _mm_set1_ps(1.0f);
+	for (int i = 0; i < count; i += 4)
+	{
+		__m128 va[4], vb[4];
+		__m128 dot = _mm_setzero_ps();
+		for (int c = 0; c < 4; c++)
+		{
+			va[c] = _mm_loadu_ps(a[c] + i);
+			vb[c] = _mm_loadu_ps(b[c] + i);
+			dot = _mm_add_ps(dot, _mm_mul_ps(va[c], vb[c]));
+		}
+		__m128 sign = _mm_and_ps(dot, signBit);
+		__m128 vt = _mm_loadu_ps(t + i);
+		__m128 s = _mm_sub_ps(one, vt);
+		__m128 q[4];
+		__m128 lengthSquared = _mm_setzero_ps();
+		for (int c = 0; c < 4; c++)
+		{
+			q[c] = _mm_add_ps(_mm_mul_ps(va[c], s), _mm_mul_ps(_mm_xor_ps(vb[c], sign), vt));
+			lengthSquared = _mm_add_ps(lengthSquared, _mm_mul_ps(q[c], q[c]));
+		}
+		__m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSquared));
+		for (int c = 0; c < 4; c++)
+			_mm_storeu_ps(out[c] + i, _mm_mul_ps(q[c], invLength));
+		_mm_storeu_ps(absDot + i, _mm_xor_ps(dot, sign));
+	}
+}
+
+CLIP_SAMPLER_AVX_TARGET inline void LerpLanesAVX(const float* a, const float* b, const float* t, float* out, int count)
+{
+	for (int i = 0; i < count; i += 8)
+	{
+		__m256 va = _mm256_loadu_ps(a + i);
+		__m256 vb = _mm256_loadu_ps(b + i);
+		__m256 vt = _mm256_loadu_ps(t + i);
+		_mm256_storeu_ps(out + i, _mm256_add_ps(va, _mm256_mul_ps(_mm256_sub_ps(vb, va), vt)));
+	}
+}
+
+CLIP_SAMPLER_AVX_TARGET inline void NlerpLanesAVX(const float* const a[4], const float* const b[4], const float* t, float* const out[4], float* absDot, int count)
+{
+	const __m256 signBit = _mm256_set1_ps(-0.0f);
+	const __m256 one = _mm256_set1_ps(1.0f);
+	for (int i = 0; i < count; i += 8)
+	{
+		__m256 va[4], vb[4];
+		__m256 dot = _mm256_setzero_ps();
+		for (int c = 0; c < 4; c++)
+		{
+			va[c] = _mm256_loadu_ps(a[c] + i);
+			vb[c] = _mm256_loadu_ps(b[c] + i);
+			dot = _mm256_add_ps(dot, _mm256_mul_ps(va[c], vb[c]));
+		}
+		__m256 sign = _mm256_and_ps(dot, signBit);
+		__m256 vt = _mm256_loadu_ps(t + i);
+		__m256 s = _mm256_sub_ps(one, vt);
+		__m256 q[4];
+		__m256 lengthSquared = _mm256_setzero_ps();
+		for (int c = 0; c < 4; c++)
+		{
+			q[c] = _mm256_add_ps(_mm256_mul_ps(va[c], s), _mm256_mul_ps(_mm256_xor_ps(vb[c], sign), vt));
+			lengthSquared = _mm256_add_ps(lengthSquared, _mm256_mul_ps(q[c], q[c]));
+		}
+		__m256 invLength = _mm256_div_ps(one, _mm256_sqrt_ps(lengthSquared));
+		for (int c = 0; c < 4; c++)
+			_mm256_storeu_ps(out[c] + i, _mm256_mul_ps(q[c], invLength));
+		_mm256_storeu_ps(absDot + i, _mm256_xor_ps(dot, sign));
+	}
+}
+#endif
+
+class ClipSampler
+{
+public:
+	// below this |dot| between two keys (a ~16 degree rotation) nlerp is off by more than ~1e-4 rad and slerp is used
+	static constexpr float NlerpMinAbsDot = 0.99f;
+
+	ClipSampler()
+		:
+		m_Clip(nullptr),
+		m_NumTracks(0),
+		m_NumLanes(0),
+		m_ISA(SAMPLER_SCALAR)
+	{
+	}
+
+	ClipSampler(const AnimationClip* clip, Sampler_ISA isa = GetSamplerISA())
+		:
+		m_Clip(clip),
+		m_NumTracks(clip->GetNumTracks()),
+		m_ISA(isa)
+	{
+		// lanes padded to the widest vector, padding samples the identity
+		m_NumLanes = (m_NumTracks + 7) & ~7;
+		m_Cursors.assign(m_NumTracks * NUM_CLIP_CHANNELS, 0);
+		for (int c = 0; c < 3; c++)
+		{
+			m_VectorA[c].assign(2 * m_NumLanes, 0.0f);
+			m_VectorB[c].assign(2 * m_NumLanes, 0.0f);
+			m_VectorOut[c].assign(2 * m_NumLanes, 0.0f);
+		}
+		m_VectorT.assign(2 * m_NumLanes, 0.0f);
+		for (int c = 0; c < 4; c++)
+		{
+			m_RotationA[c].assign(m_NumLanes, c == 3 ? 1.0f : 0.0f);
+			m_RotationB[c].assign(m_NumLanes, c == 3 ? 1.0f : 0.0f);
+			m_RotationOut[c].assign(m_NumLanes, 0.0f);
+		}
+		m_RotationT.assign(m_NumLanes, 0.0f);
+		m_AbsDot.assign(m_NumLanes, 1.0f);
+	}
+
+	Sampler_ISA GetISA() const { return m_ISA; }
+
+	// writes the local pose of every track, poses is indexed by track
+	void Sample(float animationTime, Transform* poses)
+	{
+		for (int track = 0; track < m_NumTracks; track++)
+			Gather(track, animationTime);
+
+		const float* rotationA[4] = { m_RotationA[0].data(), m_RotationA[1].data(), m_RotationA[2].data(), m_RotationA[3].data() };
+		const float* rotationB[4] = { m_RotationB[0].data(), m_RotationB[1].data(), m_RotationB[2].data(), m_RotationB[3].data() };
+		float* rotationOut[4] = { m_RotationOut[0].data(), m_RotationOut[1].data(), m_RotationOut[2].data(), m_RotationOut[3].data() };
+		switch (m_ISA)
+		{
+#if defined(CLIP_SAMPLER_X86)
+		case SAMPLER_AVX:
+			for (int c = 0; c < 3; c++)
+				LerpLanesAVX(m_VectorA[c].data(), m_VectorB[c].data(), m_VectorT.data(), m_VectorOut[c].data(), 2 * m_NumLanes);
+			NlerpLanesAVX(rotationA, rotationB, m_RotationT.data(), rotationOut, m_AbsDot.data(), m_NumLanes);
+			break;
+		case SAMPLER_SSE:
+			for (int c = 0; c < 3; c++)
+				LerpLanesSSE(m_VectorA[c].data(), m_VectorB[c].data(), m_VectorT.data(), m_VectorOut[c].data(), 2 * m_NumLanes);
+			NlerpLanesSSE(rotationA, rotationB, m_RotationT.data(), rotationOut, m_AbsDot.data(), m_NumLanes);
+			break;
+#endif
+		default:
+			for (int c = 0; c < 3; c++)
+				LerpLanesScalar(m_VectorA[c].data(), m_VectorB[c].data(), m_VectorT.data(), m_VectorOut[c].data(), 2 * m_NumLanes);
+			NlerpLanesScalar(rotationA, rotationB, m_RotationT.data(), rotationOut, m_AbsDot.data(), m_NumLanes);
+			break;
+		}
+
+		for (int track = 0; track < m_NumTracks; track++)
+		{
+			Transform& pose = poses[track];
+			int scaleLane = m_NumLanes + track;
+			pose.translation = glm::vec3(m_VectorOut[0][track], m_VectorOut[1][track], m_VectorOut[2][track]);
+			pose.scale = glm::vec3(m_VectorOut[0][scaleLane], m_VectorOut[1][scaleLane], m_VectorOut[2][scaleLane]);
+			if (m_AbsDot[track] >= NlerpMinAbsDot)
+				pose.rotation = glm::quat(m_RotationOut[3][track], m_RotationOut[0][track], m_RotationOut[1][track], m_RotationOut[2][track]);
+			else
+				pose.rotation = SlerpLane(track);
+		}
+	}
+
+private:
+	// key pair and blend factor of a channel, the same lookup Bone does
+	int FindKeys(const ClipChannel& channel, int cursor, float animationTime, float& factor)
+	{
+		const ClipTimeline& timeline = m_Clip->GetTimeline(channel);
+		factor = 0.0f;
+		if (timeline.numKeys == 1)
+			return 0;
+
+		const float* times = m_Clip->GetTimes(timeline);
+		int index = FindKeyIndex(times, timeline.numKeys, animationTime, m_Cursors[cursor]);
+		factor = (animationTime - times[index]) / (times[index + 1] - times[index]);
+		return index;
+	}
+
+	void GatherVector(const ClipChannel& channel, int cursor, int lane, float animationTime)
+	{
+		float factor;
+		int index = FindKeys(channel, cursor, animationTime, factor);
+		int next = m_Clip->GetTimeline(channel).numKeys == 1 ? index : index + 1;
+		glm::vec3 a = m_Clip->GetVector(channel, index);
+		glm::vec3 b = m_Clip->GetVector(channel, next);
+		for (int c = 0; c < 3; c++)
+		{
+			m_VectorA[c][lane] = a[c];
+			m_VectorB[c][lane] = b[c];
+		}
+		m_VectorT[lane] = factor;
+	}
+
+	void Gather(int track, float animationTime)
+	{
+		const ClipTrack& clipTrack = m_Clip->GetTrack(track);
+		int cursor = track * NUM_CLIP_CHANNELS;
+		GatherVector(clipTrack.channels[CHANNEL_POSITION], cursor + CHANNEL_POSITION, track, animationTime);
+		GatherVector(clipTrack.channels[CHANNEL_SCALE], cursor + CHANNEL_SCALE, m_NumLanes + track, animationTime);
+
+		const ClipChannel& channel = clipTrack.channels[CHANNEL_ROTATION];
+		float factor;
+		int index = FindKeys(channel, cursor + CHANNEL_ROTATION, animationTime, factor);
+		int next = m_Clip->GetTimeline(channel).numKeys == 1 ? index : index + 1;
+		glm::quat a = m_Clip->GetRotation(channel, index);
+		glm::quat b = m_Clip->GetRotation(channel, next);
+		float componentsA[4] = { a.x, a.y, a.z, a.w };
+		float componentsB[4] = { b.x, b.y, b.z, b.w };
+		for (int c = 0; c < 4; c++)
+		{
+			m_RotationA[c][track] = componentsA[c];
+			m_RotationB[c][track] = componentsB[c];
+		}
+		m_RotationT[track] = factor;
+	}
+
+	glm::quat SlerpLane(int lane) const
+	{
+		glm::quat a(m_RotationA[3][lane], m_RotationA[0][lane], m_RotationA[1][lane], m_RotationA[2][lane]);
+		glm::quat b(m_RotationB[3][lane], m_RotationB[0][lane], m_RotationB[1][lane], m_RotationB[2][lane]);
+		return glm::normalize(glm::slerp(a, b, m_RotationT[lane]));
+	}
+
+	const AnimationClip* m_Clip;
+	int m_NumTracks;
+	int m_NumLanes;
+	Sampler_ISA m_ISA;
+
+	// last key index per track and channel
+	std::vector<int> m_Cursors;
+
+	// vector lanes [0, m_NumLanes) are positions, [m_NumLanes, 2 * m_NumLanes) scales
+	std::vector<float> m_VectorA[3], m_VectorB[3], m_VectorOut[3];
+	std::vector<float> m_VectorT;
+	std::vector<float> m_RotationA[4], m_RotationB[4], m_RotationOut[4];
+	std::vector<float> m_RotationT;
+	std::vector<float> m_AbsDot;
+};
@@ -0,0 +1,205 @@
+#pragma once
+
+/* Cooked animation file: the clips of one source file, the skeleton they were bound to and their track-to-joint
+   tables. Written by ClipLibrary::Cook and read in place from a memory mapping, every section starts on a page
+   boundary so AnimationClip samples the mapped clip data directly.
+   A cooked file is stale when its version, the source file's size and time, the compression settings or the
+   skeleton differ from the ones it was cooked with; ClipLibrary then imports the source with Assimp instead. */
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <learnopengl/animation_clip.h>
+#include <learnopengl/clip_compression.h>
+#include <learnopengl/cooked_file.h>
+#include <learnopengl/mapped_file.h>
+#include <learnopengl/skeleton.h>
+#include <learnopengl/transform.h>
+
+const uint32_t CookedAnimationMagic = 0x4D494E41;	// "ANIM"
+const uint32_t CookedAnimationVersion = 1;
+const char* const CookedAnimationExtension = ".anim";
+
+struct CookedAnimationHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	uint64_t settingsHash;
+	uint32_t numClips;
+	uint32_t numJoints;
+	uint64_t clipsOffset;		// CookedClipEntry[numClips]
+	uint64_t jointsOffset;		// CookedJoint[numJoints]
+	uint64_t namesOffset;		// zero terminated joint and clip names
+	uint64_t namesSize;
+	uint64_t totalSize;
+};
+
+struct CookedClipEntry
+{
+	uint32_t nameOffset;
+	uint32_t numTracks;
+	uint64_t trackJointsOffset;	// int32_t[numTracks]
+	uint64_t dataOffset;		// AnimationClip data
+	uint64_t dataSize;
+};
+
+struct CookedClipSource
+{
+	std::string name;
+	const AnimationClip* clip;
+	const std::vector<int>* trackJoints;
+};
+
+// FNV-1a over everything that changes the compressed clips
+inline uint64_t HashCompressionSettings(const ClipCompressionSettings& settings)
+{
+	uint64_t hash = 14695981039346656037ull;
+	auto add = [&](const void* data, size_t size)
+	{
+		for (size_t i = 0; i < size; i++)
+			hash = (hash ^ static_cast<const unsigned char*>(data)[i]) * 1099511628211ull;
+	};
+	add(&settings.enabled, sizeof(settings.enabled));
+	add(&settings.tolerance, sizeof(settings.tolerance));
+	add(&settings.virtualVertexDistance, sizeof(settings.virtualVertexDistance));
+	for (auto& bone : settings.boneTolerances)
+	{
+		add(bone.first.c_str(), bone.first.size() + 1);
+		add(&bone.second, sizeof(bone.second));
+	}
+	return hash;
+}
+
+inline bool WriteCookedAnimation(const std::string& path, const FileStamp& source, uint64_t settingsHash,
+	const Skeleton& skeleton, const std::vector<CookedClipSource>& clips)
+{
+	std::string names;
+	std::vector<CookedJoint> joints = CookJoints(skeleton, names);
+
+	std::vector<CookedClipEntry> entries(clips.size());
+	for (size_t i = 0; i < clips.size(); i++)
+	{
+		entries[i].nameOffset = static_cast<uint32_t>(names.size());
+		names.append(clips[i].name).push_back('\0');
+	}
+
+	CookedAnimationHeader header = {};
+	header.magic = CookedAnimationMagic;
+	header.version = CookedAnimationVersion;
+	header.sourceSize = source.size;
+	header.sourceTime = source.time;
+	header.settingsHash = settingsHash;
+	header.numClips = static_cast<uint32_t>(clips.size());
+	header.numJoints = static_cast<uint32_t>(joints.size());
+	header.clipsOffset = AlignToPage(sizeof(header));
+	header.jointsOffset = AlignToPage(header.clipsOffset + entries.size() * sizeof(CookedClipEntry));
+	header.namesOffset = AlignToPage(header.jointsOffset + joints.size() * sizeof(CookedJoint));
+	header.namesSize = names.size();
+
+	uint64_t size = AlignToPage(header.namesOffset + names.size());
+	for (size_t i = 0; i < clips.size(); i++)
+	{
+		entries[i].numTracks = static_cast<uint32_t>(clips[i].trackJoints->size());
+		entries[i].trackJointsOffset = size;
+		entries[i].dataOffset = AlignToPage(size + entries[i].numTracks * sizeof(int32_t));
+		entries[i].dataSize = clips[i].clip->GetSizeInBytes();
+		size = AlignToPage(entries[i].dataOffset + entries[i].dataSize);
+	}
+	header.totalSize = size;
+
+	std::vector<unsigned char> file(size, 0);
+	std::memcpy(&file[0], &header, sizeof(header));
+	if (!entries.empty())
+		std::memcpy(&file[header.clipsOffset], entries.data(), entries.size() * sizeof(CookedClipEntry));
+	if (!joints.empty())
+		std::memcpy(&file[header.jointsOffset], joints.data(), joints.size() * sizeof(CookedJoint));
+	std::memcpy(&file[header.namesOffset], names.data(), names.size());
+	for (size_t i = 0; i < clips.size(); i++)
+	{
+		int32_t* trackJoints = reinterpret_cast<int32_t*>(&file[entries[i].trackJointsOffset]);
+		for (uint32_t track = 0; track < entries[i].numTracks; track++)
+			trackJoints[track] = (*clips[i].trackJoints)[track];
+		std::memcpy(&file[entries[i].dataOffset], &clips[i].clip->GetHeader(), entries[i].dataSize);
+	}
+
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	out.write(reinterpret_cast<const char*>(file.data()), file.size());
+	return out.good();
+}
+
+class CookedAnimationFile
+{
+public:
+	// maps path and checks that it was cooked from source with the same settings by this version
+	bool Open(const std::string& path, const FileStamp& source, uint64_t settingsHash)
+	{
+		auto file = std::make_shared<MappedFile>();
+		if (!file->Open(path) || file->GetSize() < sizeof(CookedAnimationHeader))
+			return false;
+		m_File = file;
+		const CookedAnimationHeader& header = GetHeader();
+		if (header.magic != CookedAnimationMagic || header.version != CookedAnimationVersion || header.totalSize != file->GetSize()
+			|| header.sourceSize != source.size || header.sourceTime != source.time || header.settingsHash != settingsHash
+			|| header.clipsOffset + header.numClips * sizeof(CookedClipEntry) > header.totalSize
+			|| header.jointsOffset + header.numJoints * sizeof(CookedJoint) > header.totalSize
+			|| header.namesOffset + header.namesSize > header.totalSize)
+		{
+			m_File.reset();
+			return false;
+		}
+		for (int i = 0; i < GetNumClips(); i++)
+		{
+			const CookedClipEntry& entry = GetEntry(i);
+			if (entry.dataOffset % CookedPageSize != 0 || entry.dataOffset + entry.dataSize > header.totalSize
+				|| entry.trackJointsOffset + entry.numTracks * sizeof(int32_t) > header.totalSize
+				|| reinterpret_cast<const ClipHeader*>(m_File->GetData() + entry.dataOffset)->totalSize != entry.dataSize)
+			{
+				m_File.reset();
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// the precomputed track-to-joint tables are only valid for the skeleton the file was cooked with
+	bool MatchesSkeleton(const Skeleton& skeleton) const
+	{
+		if (static_cast<int>(GetHeader().numJoints) != skeleton.GetNumJoints())
+			return false;
+		const CookedJoint* joints = At<CookedJoint>(GetHeader().jointsOffset);
+		for (int i = 0; i < skeleton.GetNumJoints(); i++)
+		{
+			if (joints[i].parent != skeleton.GetParents()[i] || joints[i].boneID != skeleton.GetBoneIDs()[i]
+				|| skeleton.GetNames()[i] != GetName(joints[i].nameOffset))
+				return false;
+		}
+		return true;
+	}
+
+	inline bool IsOpen() const { return m_File != nullptr; }
+	inline int GetNumClips() const { return static_cast<int>(GetHeader().numClips); }
+	inline const char* GetClipName(int clip) const { return GetName(GetEntry(clip).nameOffset); }
+	inline const int32_t* GetTrackJoints(int clip) const { return At<int32_t>(GetEntry(clip).trackJointsOffset); }
+
+	// the clip reads the mapped data in place and keeps the mapping alive
+	std::shared_ptr<AnimationClip> GetClip(int clip) const
+	{
+		return std::make_shared<AnimationClip>(At<unsigned char>(GetEntry(clip).dataOffset), m_File);
+	}
+
+private:
+	inline const CookedAnimationHeader& GetHeader() const { return *At<CookedAnimationHeader>(0); }
+	inline const CookedClipEntry& GetEntry(int clip) const { return At<CookedClipEntry>(GetHeader().clipsOffset)[clip]; }
+	inline const char* GetName(uint32_t offset) const { return At<char>(GetHeader().namesOffset) + offset; }
+
+	template<typename T>
+	inline const T* At(uint64_t offset) const { return reinterpret_cast<const T*>(m_File->GetData() + offset); }
+
+	std::shared_ptr<MappedFile> m_File;
+};
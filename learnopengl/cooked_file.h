@@ -0,0 +1,52 @@
+#pragma once
+
+/* Pieces shared by the cooked asset formats (cooked_animation.h, cooked_mesh.h):
+   page alignment of sections and the skeleton stored with the data bound to it. */
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <learnopengl/skeleton.h>
+#include <learnopengl/transform.h>
+
+const uint64_t CookedPageSize = 4096;
+
+inline uint64_t AlignToPage(uint64_t offset)
+{
+	return (offset + CookedPageSize - 1) / CookedPageSize * CookedPageSize;
+}
+
+struct CookedJoint
+{
+	int32_t parent;
+	int32_t boneID;
+	uint32_t nameOffset;
+	Transform bindPose;
+	glm::mat4x3 offset;
+};
+
+// joint records of skeleton, their names are appended to names
+inline std::vector<CookedJoint> CookJoints(const Skeleton& skeleton, std::string& names)
+{
+	std::vector<CookedJoint> joints(skeleton.GetNumJoints());
+	for (int i = 0; i < skeleton.GetNumJoints(); i++)
+	{
+		joints[i].parent = skeleton.GetParents()[i];
+		joints[i].boneID = skeleton.GetBoneIDs()[i];
+		joints[i].nameOffset = static_cast<uint32_t>(names.size());
+		joints[i].bindPose = skeleton.GetBindPoses()[i];
+		joints[i].offset = skeleton.GetOffsets()[i];
+		names.append(skeleton.GetNames()[i]).push_back('\0');
+	}
+	return joints;
+}
+
+inline std::shared_ptr<Skeleton> ReadCookedJoints(const CookedJoint* joints, int numJoints, const char* names)
+{
+	auto skeleton = std::make_shared<Skeleton>();
+	for (int i = 0; i < numJoints; i++)
+		skeleton->AddJoint(names + joints[i].nameOffset, joints[i].parent, joints[i].bindPose, joints[i].boneID, joints[i].offset);
+	return skeleton;
+}
@@ -0,0 +1,255 @@
+#pragma once
+
+/* Cooked model file: interleaved Vertex and index blobs of every mesh, their material texture references,
+   the textures embedded in the source file, the bone info map and the skeleton.
+   Written by Model::Cook, mapped by Model at load so the blobs go from the page cache straight to glBufferData.
+   A cooked file is stale when its version or the source file's size and time differ; Model then imports with Assimp. */
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <learnopengl/animdata.h>
+#include <learnopengl/cooked_file.h>
+#include <learnopengl/mapped_file.h>
+#include <learnopengl/mesh.h>
+#include <learnopengl/skeleton.h>
+
+const uint32_t CookedMeshMagic = 0x4853454D;	// "MESH"
+const uint32_t CookedMeshVersion = 2;
+const char* const CookedMeshExtension = ".mesh";
+
+struct CookedMeshHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertexSize;		// sizeof(Vertex) the blobs were written with
+	uint32_t numMeshes;
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	uint32_t numTextureRefs;
+	uint32_t numEmbedded;
+	uint32_t numBones;
+	uint32_t numJoints;
+	uint64_t meshesOffset;		// CookedMeshEntry[numMeshes]
+	uint64_t textureRefsOffset;	// CookedTextureRef[numTextureRefs]
+	uint64_t embeddedOffset;	// CookedEmbeddedTexture[numEmbedded]
+	uint64_t bonesOffset;		// CookedBone[numBones]
+	uint64_t jointsOffset;		// CookedJoint[numJoints]
+	uint64_t namesOffset;		// zero terminated texture types, paths and bone names
+	uint64_t namesSize;
+	uint64_t totalSize;
+};
+
+struct CookedMeshEntry
+{
+	uint64_t verticesOffset;	// Vertex[numVertices]
+	uint64_t indicesOffset;		// uint32_t[numIndices]
+	uint32_t numVertices;
+	uint32_t numIndices;
+	uint32_t firstTextureRef;
+	uint32_t numTextureRefs;
+};
+
+struct CookedTextureRef
+{
+	uint32_t typeOffset;
+	uint32_t pathOffset;
+};
+
+// file contents of a texture embedded in the source, decoded at load like the Assimp path does
+struct CookedEmbeddedTexture
+{
+	uint32_t pathOffset;
+	uint32_t size;
+	uint64_t dataOffset;
+};
+
+struct CookedBone
+{
+	uint32_t nameOffset;
+	int32_t id;
+	glm::mat4 offset;
+};
+
+struct CookedMeshSource
+{
+	const Vertex* vertices;
+	unsigned int numVertices;
+	const unsigned int* indices;
+	unsigned int numIndices;
+	const std::vector<MeshTextureRef>* textures;
+};
+
+struct CookedEmbeddedSource
+{
+	std::string path;
+	const unsigned char* data;
+	uint32_t size;
+};
+
+inline bool WriteCookedMesh(const std::string& path, const FileStamp& source, const std::vector<CookedMeshSource>& meshes,
+	const std::vector<CookedEmbeddedSource>& embedded, const std::map<std::string, BoneInfo>& boneInfoMap, const Skeleton& skeleton)
+{
+	std::string names;
+	auto addName = [&](const std::string& name)
+	{
+		uint32_t offset = static_cast<uint32_t>(names.size());
+		names.append(name).push_back('\0');
+		return offset;
+	};
+
+	std::vector<CookedMeshEntry> entries(meshes.size());
+	std::vector<CookedTextureRef> textureRefs;
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		entries[i].numVertices = meshes[i].numVertices;
+		entries[i].numIndices = meshes[i].numIndices;
+		entries[i].firstTextureRef = static_cast<uint32_t>(textureRefs.size());
+		entries[i].numTextureRefs = static_cast<uint32_t>(meshes[i].textures->size());
+		for (const MeshTextureRef& texture : *meshes[i].textures)
+			textureRefs.push_back({ addName(texture.type), addName(texture.path) });
+	}
+
+	std::vector<CookedEmbeddedTexture> embeddedEntries(embedded.size());
+	for (size_t i = 0; i < embedded.size(); i++)
+	{
+		embeddedEntries[i].pathOffset = addName(embedded[i].path);
+		embeddedEntries[i].size = embedded[i].size;
+	}
+
+	std::vector<CookedBone> bones;
+	for (auto& bone : boneInfoMap)
+		bones.push_back({ addName(bone.first), bone.second.id, bone.second.offset });
+	std::vector<CookedJoint> joints = CookJoints(skeleton, names);
+
+	CookedMeshHeader header = {};
+	header.magic = CookedMeshMagic;
+	header.version = CookedMeshVersion;
+	header.vertexSize = sizeof(Vertex);
+	header.numMeshes = static_cast<uint32_t>(entries.size());
+	header.sourceSize = source.size;
+	header.sourceTime = source.time;
+	header.numTextureRefs = static_cast<uint32_t>(textureRefs.size());
+	header.numEmbedded = static_cast<uint32_t>(embeddedEntries.size());
+	header.numBones = static_cast<uint32_t>(bones.size());
+	header.numJoints = static_cast<uint32_t>(joints.size());
+	header.meshesOffset = AlignToPage(sizeof(header));
+	header.textureRefsOffset = AlignToPage(header.meshesOffset + entries.size() * sizeof(CookedMeshEntry));
+	header.embeddedOffset = AlignToPage(header.textureRefsOffset + textureRefs.size() * sizeof(CookedTextureRef));
+	header.bonesOffset = AlignToPage(header.embeddedOffset + embeddedEntries.size() * sizeof(CookedEmbeddedTexture));
+	header.jointsOffset = AlignToPage(header.bonesOffset + bones.size() * sizeof(CookedBone));
+	header.namesOffset = AlignToPage(header.jointsOffset + joints.size() * sizeof(CookedJoint));
+	header.namesSize = names.size();
+
+	uint64_t size = AlignToPage(header.namesOffset + names.size());
+	for (CookedMeshEntry& entry : entries)
+	{
+		entry.verticesOffset = size;
+		entry.indicesOffset = AlignToPage(entry.verticesOffset + uint64_t(entry.numVertices) * sizeof(Vertex));
+		size = AlignToPage(entry.indicesOffset + uint64_t(entry.numIndices) * sizeof(uint32_t));
+	}
+	for (CookedEmbeddedTexture& entry : embeddedEntries)
+	{
+		entry.dataOffset = size;
+		size = AlignToPage(entry.dataOffset + entry.size);
+	}
+	header.totalSize = size;
+
+	std::vector<unsigned char> file(size, 0);
+	auto write = [&](uint64_t offset, const void* data, size_t bytes)
+	{
+		if (bytes)
+			std::memcpy(&file[offset], data, bytes);
+	};
+	write(0, &header, sizeof(header));
+	write(header.meshesOffset, entries.data(), entries.size() * sizeof(CookedMeshEntry));
+	write(header.textureRefsOffset, textureRefs.data(), textureRefs.size() * sizeof(CookedTextureRef));
+	write(header.embeddedOffset, embeddedEntries.data(), embeddedEntries.size() * sizeof(CookedEmbeddedTexture));
+	write(header.bonesOffset, bones.data(), bones.size() * sizeof(CookedBone));
+	write(header.jointsOffset, joints.data(), joints.size() * sizeof(CookedJoint));
+	write(header.namesOffset, names.data(), names.size());
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		write(entries[i].verticesOffset, meshes[i].vertices, entries[i].numVertices * sizeof(Vertex));
+		write(entries[i].indicesOffset, meshes[i].indices, entries[i].numIndices * sizeof(uint32_t));
+	}
+	for (size_t i = 0; i < embedded.size(); i++)
+		write(embeddedEntries[i].dataOffset, embedded[i].data, embedded[i].size);
+
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	out.write(reinterpret_cast<const char*>(file.data()), file.size());
+	return out.good();
+}
+
+class CookedMeshFile
+{
+public:
+	// maps path and checks that it was cooked from source by this version
+	bool Open(const std::string& path, const FileStamp& source)
+	{
+		auto file = std::make_shared<MappedFile>();
+		if (!file->Open(path) || file->GetSize() < sizeof(CookedMeshHeader))
+			return false;
+		m_File = file;
+		const CookedMeshHeader& header = GetHeader();
+		bool valid = header.magic == CookedMeshMagic && header.version == CookedMeshVersion && header.vertexSize == sizeof(Vertex)
+			&& header.totalSize == file->GetSize() && header.sourceSize == source.size && header.sourceTime == source.time
+			&& header.meshesOffset + header.numMeshes * sizeof(CookedMeshEntry) <= header.totalSize
+			&& header.textureRefsOffset + header.numTextureRefs * sizeof(CookedTextureRef) <= header.totalSize
+			&& header.embeddedOffset + header.numEmbedded * sizeof(CookedEmbeddedTexture) <= header.totalSize
+			&& header.bonesOffset + header.numBones * sizeof(CookedBone) <= header.totalSize
+			&& header.jointsOffset + header.numJoints * sizeof(CookedJoint) <= header.totalSize
+			&& header.namesOffset + header.namesSize <= header.totalSize;
+		for (int i = 0; i < GetNumMeshes() && valid; i++)
+		{
+			const CookedMeshEntry& entry = GetMesh(i);
+			valid = entry.verticesOffset + uint64_t(entry.numVertices) * sizeof(Vertex) <= header.totalSize
+				&& entry.indicesOffset + uint64_t(entry.numIndices) * sizeof(uint32_t) <= header.totalSize
+				&& entry.firstTextureRef + entry.numTextureRefs <= header.numTextureRefs;
+		}
+		for (int i = 0; i < GetNumEmbedded() && valid; i++)
+			valid = GetEmbedded(i).dataOffset + GetEmbedded(i).size <= header.totalSize;
+		if (!valid)
+			m_File.reset();
+		return valid;
+	}
+
+	inline bool IsOpen() const { return m_File != nullptr; }
+	inline std::shared_ptr<const void> GetOwner() const { return m_File; }
+
+	inline int GetNumMeshes() const { return static_cast<int>(GetHeader().numMeshes); }
+	inline const CookedMeshEntry& GetMesh(int mesh) const { return At<CookedMeshEntry>(GetHeader().meshesOffset)[mesh]; }
+	inline const Vertex* GetVertices(int mesh) const { return At<Vertex>(GetMesh(mesh).verticesOffset); }
+	inline const unsigned int* GetIndices(int mesh) const { return At<unsigned int>(GetMesh(mesh).indicesOffset); }
+	inline const CookedTextureRef& GetTextureRef(int mesh, int texture) const
+	{
+		return At<CookedTextureRef>(GetHeader().textureRefsOffset)[GetMesh(mesh).firstTextureRef + texture];
+	}
+
+	inline int GetNumEmbedded() const { return static_cast<int>(GetHeader().numEmbedded); }
+	inline const CookedEmbeddedTexture& GetEmbedded(int texture) const { return At<CookedEmbeddedTexture>(GetHeader().embeddedOffset)[texture]; }
+	inline const unsigned char* GetEmbeddedData(int texture) const { return At<unsigned char>(GetEmbedded(texture).dataOffset); }
+
+	inline int GetNumBones() const { return static_cast<int>(GetHeader().numBones); }
+	inline const CookedBone& GetBone(int bone) const { return At<CookedBone>(GetHeader().bonesOffset)[bone]; }
+
+	inline const char* GetName(uint32_t offset) const { return At<char>(GetHeader().namesOffset) + offset; }
+
+	std::shared_ptr<Skeleton> ReadSkeleton() const
+	{
+		return ReadCookedJoints(At<CookedJoint>(GetHeader().jointsOffset), GetHeader().numJoints, At<char>(GetHeader().namesOffset));
+	}
+
+private:
+	inline const CookedMeshHeader& GetHeader() const { return *At<CookedMeshHeader>(0); }
+
+	template<typename T>
+	inline const T* At(uint64_t offset) const { return reinterpret_cast<const T*>(m_File->GetData() + offset); }
+
+	std::shared_ptr<MappedFile> m_File;
+};
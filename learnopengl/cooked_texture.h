@@ -0,0 +1,194 @@
+#pragma once
+
+/* Cooked texture file: the full mip chain of one image, block compressed on the CPU (see texture_compression.h),
+   tagged sRGB or linear. Written by CookTexture, mapped by TextureCache and uploaded with glCompressedTexImage2D.
+   A file texture's cooked file sits next to it and is stale when the source's size or time differ; textures
+   embedded in a model are cooked next to the model under their content hash, so they can't go stale. */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stb_image.h>
+#include <learnopengl/cooked_file.h>
+#include <learnopengl/mapped_file.h>
+#include <learnopengl/texture_compression.h>
+
+const uint32_t CookedTextureMagic = 0x58455443;	// "CTEX"
+const uint32_t CookedTextureVersion = 1;
+const char* const CookedTextureExtension = ".ctex";
+
+struct CookedTextureHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t format;		// CookedTextureFormat
+	uint32_t srgb;			// colour data, sampled through an sRGB format when gamma correction is on
+	uint32_t width;
+	uint32_t height;
+	uint32_t numMips;
+	uint32_t reserved;
+	uint64_t sourceSize;
+	int64_t sourceTime;		// 0 for embedded textures, matched by contentHash alone
+	uint64_t contentHash;	// of the encoded source, TextureCache's key
+	uint64_t mipsOffset;	// CookedTextureMip[numMips]
+	uint64_t totalSize;
+};
+
+struct CookedTextureMip
+{
+	uint32_t width;
+	uint32_t height;
+	uint64_t dataOffset;
+	uint64_t dataSize;
+};
+
+// what the texture holds decides its format and how its mips are filtered
+enum TextureUsage
+{
+	TextureUsageColor,	// sRGB, BC1 or BC3 with alpha
+	TextureUsageData,	// linear, BC1 or BC3 with alpha
+	TextureUsageNormal,	// linear, BC5 holding X and Y; Z is rebuilt in the shader
+};
+
+struct TextureCookSettings
+{
+	bool useBC7 = false;	// BC7 instead of BC1/BC3 for colour and data textures: twice the size of BC1, less banding
+};
+
+// FNV-1a over an encoded image, the content hash textures are cached and cooked by
+inline uint64_t HashTextureContents(const unsigned char* data, size_t size)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ data[i]) * 1099511628211ull;
+	return hash;
+}
+
+// where a texture embedded in a model in directory is cooked to
+inline std::string GetEmbeddedCookedPath(const std::string& directory, uint64_t contentHash)
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "/embedded_%016llx", static_cast<unsigned long long>(contentHash));
+	return directory + name + CookedTextureExtension;
+}
+
+// decodes an encoded image, builds its mips, compresses them and writes cookedPath. sourceTime 0 marks an embedded image
+inline bool CookTexture(const std::string& cookedPath, const unsigned char* encoded, size_t size, int64_t sourceTime,
+	TextureUsage usage, const TextureCookSettings& settings = TextureCookSettings())
+{
+	TextureImage image;
+	int components;
+	unsigned char* pixels = stbi_load_from_memory(encoded, static_cast<int>(size), &image.width, &image.height, &components, 4);
+	if (!pixels)
+	{
+		std::cout << "ERROR::COOK:: could not decode the source of " << cookedPath << std::endl;
+		return false;
+	}
+	image.rgba.assign(pixels, pixels + size_t(image.width) * image.height * 4);
+	stbi_image_free(pixels);
+
+	bool opaque = true;
+	for (size_t i = 3; i < image.rgba.size() && opaque; i += 4)
+		opaque = image.rgba[i] == 255;
+	bool srgb = usage == TextureUsageColor;
+	uint32_t format = usage == TextureUsageNormal ? TextureFormatBC5
+		: settings.useBC7 ? TextureFormatBC7 : opaque ? TextureFormatBC1 : TextureFormatBC3;
+	int psnrChannels = format == TextureFormatBC5 ? 2 : opaque ? 3 : 4;
+
+	std::vector<TextureImage> mips(1, image);
+	while (mips.back().width > 1 || mips.back().height > 1)
+		mips.push_back(DownsampleImage(mips.back(), srgb, usage == TextureUsageNormal));
+
+	std::vector<std::vector<unsigned char>> blocks(mips.size());
+	for (size_t i = 0; i < mips.size(); i++)
+		blocks[i] = CompressImage(mips[i], format);
+	double psnr = ComputePSNR(image, DecompressImage(blocks[0].data(), image.width, image.height, format), psnrChannels);
+
+	CookedTextureHeader header = {};
+	header.magic = CookedTextureMagic;
+	header.version = CookedTextureVersion;
+	header.format = format;
+	header.srgb = srgb ? 1 : 0;
+	header.width = image.width;
+	header.height = image.height;
+	header.numMips = static_cast<uint32_t>(mips.size());
+	header.sourceSize = size;
+	header.sourceTime = sourceTime;
+	header.contentHash = HashTextureContents(encoded, size);
+	header.mipsOffset = AlignToPage(sizeof(header));
+
+	std::vector<CookedTextureMip> entries(mips.size());
+	uint64_t offset = AlignToPage(header.mipsOffset + entries.size() * sizeof(CookedTextureMip));
+	for (size_t i = 0; i < mips.size(); i++)
+	{
+		entries[i].width = mips[i].width;
+		entries[i].height = mips[i].height;
+		entries[i].dataOffset = offset;
+		entries[i].dataSize = blocks[i].size();
+		offset += blocks[i].size();
+	}
+	header.totalSize = offset;
+
+	std::vector<unsigned char> file(header.totalSize, 0);
+	std::memcpy(&file[0], &header, sizeof(header));
+	std::memcpy(&file[header.mipsOffset], entries.data(), entries.size() * sizeof(CookedTextureMip));
+	for (size_t i = 0; i < mips.size(); i++)
+		std::memcpy(&file[entries[i].dataOffset], blocks[i].data(), blocks[i].size());
+
+	std::ofstream out(cookedPath, std::ios::binary | std::ios::trunc);
+	out.write(reinterpret_cast<const char*>(file.data()), file.size());
+	if (!out.good())
+	{
+		std::cout << "ERROR::COOK:: could not write " << cookedPath << std::endl;
+		return false;
+	}
+	std::cout << "Cooked " << cookedPath << ": " << GetTextureFormatName(format) << (srgb ? " sRGB " : " linear ") << image.width << "x"
+		<< image.height << ", " << mips.size() << " mips, " << file.size() / 1024 << " KB (" << image.rgba.size() * 4 / 3 / 1024
+		<< " KB as RGBA8 with mips), PSNR " << psnr << " dB" << std::endl;
+	return true;
+}
+
+class CookedTextureFile
+{
+public:
+	// maps path and checks that it was cooked by this version from a source of this size and time (0 when embedded)
+	// and, when contentHash isn't 0, with these contents
+	bool Open(const std::string& path, uint64_t sourceSize, int64_t sourceTime, uint64_t contentHash = 0)
+	{
+		auto file = std::make_shared<MappedFile>();
+		if (!file->Open(path) || file->GetSize() < sizeof(CookedTextureHeader))
+			return false;
+		m_File = file;
+		const CookedTextureHeader& header = GetHeader();
+		bool valid = header.magic == CookedTextureMagic && header.version == CookedTextureVersion && header.totalSize == file->GetSize()
+			&& header.sourceSize == sourceSize && header.sourceTime == sourceTime && (contentHash == 0 || header.contentHash == contentHash)
+			&& header.format >= TextureFormatBC1 && header.format <= TextureFormatBC7 && header.numMips > 0
+			&& header.mipsOffset + header.numMips * sizeof(CookedTextureMip) <= header.totalSize;
+		for (int i = 0; i < GetNumMips() && valid; i++)
+		{
+			const CookedTextureMip& mip = GetMip(i);
+			size_t expected = size_t((mip.width + 3) / 4) * ((mip.height + 3) / 4) * GetBlockSize(header.format);
+			valid = mip.dataSize == expected && mip.dataOffset + mip.dataSize <= header.totalSize;
+		}
+		if (!valid)
+			m_File.reset();
+		return valid;
+	}
+
+	inline bool IsOpen() const { return m_File != nullptr; }
+	inline const CookedTextureHeader& GetHeader() const { return *reinterpret_cast<const CookedTextureHeader*>(m_File->GetData()); }
+	inline int GetNumMips() const { return static_cast<int>(GetHeader().numMips); }
+	inline const CookedTextureMip& GetMip(int mip) const
+	{
+		return reinterpret_cast<const CookedTextureMip*>(m_File->GetData() + GetHeader().mipsOffset)[mip];
+	}
+	inline const unsigned char* GetMipData(int mip) const { return m_File->GetData() + GetMip(mip).dataOffset; }
+
+private:
+	std::shared_ptr<MappedFile> m_File;
+};
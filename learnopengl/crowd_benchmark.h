@@ -0,0 +1,187 @@
+#pragma once
+
+/* Timing run for drawing crowds of one character, started with "OpenGL.exe --crowd-bench" once the character has
+   loaded. Compares SkinnedCrowd's instanced draws, with palettes from the CPU or baked, with a Character block and a
+   Draw per character. */
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/baked_animation.h>
+#include <learnopengl/model_animation.h>
+#include <learnopengl/shader_variants.h>
+#include <learnopengl/skinned_crowd.h>
+#include <learnopengl/uniform_buffer.h>
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+struct CrowdFrameTimes
+{
+	double packMs = 0.0;	// building the palettes or blocks
+	double uploadMs = 0.0;
+	double submitMs = 0.0;	// issuing the draws
+	double gpuMs = 0.0;		// GL_TIME_ELAPSED around the draws
+};
+
+// instances on a square grid facing the camera, a bit over a character's width apart
+inline glm::mat4 GetCrowdModelMatrix(int instance, int count)
+{
+	int side = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(count))));
+	float x = (instance % side - 0.5f * (side - 1)) * 1.5f;
+	float z = -2.0f - (instance / side) * 1.5f;
+	glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(x, -1.3f, z));
+	return glm::scale(model, glm::vec3(.02f, .02f, .02f));
+}
+
+inline double GetElapsedMs(std::chrono::high_resolution_clock::time_point& start)
+{
+	auto now = std::chrono::high_resolution_clock::now();
+	double ms = std::chrono::duration<double, std::milli>(now - start).count();
+	start = now;
+	return ms;
+}
+
+// waits for query and adds its nanoseconds to times.gpuMs
+inline void AddGpuTime(GLuint query, CrowdFrameTimes& times)
+{
+	GLuint64 elapsed = 0;
+	glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+	times.gpuMs += elapsed / 1000000.0;
+}
+
+inline void PrintCrowdTimes(const char* path, int count, const CrowdFrameTimes& total, int numFrames)
+{
+	std::cout << "  " << path << " " << count << ": pack " << total.packMs / numFrames << " ms, upload " << total.uploadMs / numFrames
+		<< " ms, submit " << total.submitMs / numFrames << " ms, GPU " << total.gpuMs / numFrames << " ms per frame" << std::endl;
+}
+
+// every character posed with palette, or playing animation baked; camera has to be bound at CameraBlockBinding already
+inline int RunCrowdBenchmark(Model& model, ShaderVariants& variants, const std::vector<glm::mat4>& palette, Animation& animation)
+{
+	const int Counts[] = { 1, 100, 1000, 10000 };
+	const int MaxPerCharacterCount = 1000;
+	const int NumWarmupFrames = 3;
+	const int NumFrames = 20;
+
+	int numBones = std::max(model.GetBoneCount(), 1);
+	std::cout << "Crowd: " << model.meshes.size() << " meshes, " << numBones << " bones, " << NumFrames << " frames per run" << std::endl;
+	GLuint query = 0;
+	glGenQueries(1, &query);
+
+	BakedAnimation baked(animation.GetSkeleton().GetPaletteSize());
+	auto bakeStart = std::chrono::high_resolution_clock::now();
+	int bakedClip = baked.Bake(animation, "Benchmark");
+	double bakeMs = GetElapsedMs(bakeStart);
+	bool bakedUploaded = bakedClip >= 0 && baked.Upload();
+	if (bakedUploaded)
+		std::cout << "  baked " << baked.GetClip(bakedClip).numFrames << " frames of " << baked.GetNumBones() << " bones in " << bakeMs
+			<< " ms, " << baked.GetSizeInBytes() / 1024 << " KB" << std::endl;
+
+	for (int count : Counts)
+	{
+		SkinnedCrowd crowd(count, numBones);
+		if (crowd.GetMaxInstances() < count)
+			continue;
+		CrowdFrameTimes total;
+		for (int frame = 0; frame < NumWarmupFrames + NumFrames; frame++)
+		{
+			CrowdFrameTimes times;
+			auto start = std::chrono::high_resolution_clock::now();
+			crowd.Clear();
+			for (int i = 0; i < count; i++)
+				crowd.Add(GetCrowdModelMatrix(i, count), palette);
+			times.packMs = GetElapsedMs(start);
+			crowd.Upload();
+			times.uploadMs = GetElapsedMs(start);
+			glBeginQuery(GL_TIME_ELAPSED, query);
+			crowd.Draw(model, variants);
+			glEndQuery(GL_TIME_ELAPSED);
+			times.submitMs = GetElapsedMs(start);
+			AddGpuTime(query, times);
+			if (frame >= NumWarmupFrames)
+			{
+				total.packMs += times.packMs;
+				total.uploadMs += times.uploadMs;
+				total.submitMs += times.submitMs;
+				total.gpuMs += times.gpuMs;
+			}
+		}
+		PrintCrowdTimes("instanced", count, total, NumFrames);
+
+		// baked: the instances are written once, a frame only moves the time
+		if (bakedUploaded)
+		{
+			SkinnedCrowd bakedCrowd(count, 0);
+			total = CrowdFrameTimes();
+			auto packStart = std::chrono::high_resolution_clock::now();
+			for (int i = 0; i < count; i++)
+				bakedCrowd.AddBaked(GetCrowdModelMatrix(i, count), bakedClip, 0.37f * i);
+			double packMs = GetElapsedMs(packStart);
+			auto uploadStart = std::chrono::high_resolution_clock::now();
+			bakedCrowd.Upload();
+			double uploadMs = GetElapsedMs(uploadStart);
+			for (int frame = 0; frame < NumWarmupFrames + NumFrames; frame++)
+			{
+				CrowdFrameTimes times;
+				auto start = std::chrono::high_resolution_clock::now();
+				glBeginQuery(GL_TIME_ELAPSED, query);
+				bakedCrowd.DrawBaked(model, variants, baked, frame / 60.0f);
+				glEndQuery(GL_TIME_ELAPSED);
+				times.submitMs = GetElapsedMs(start);
+				AddGpuTime(query, times);
+				if (frame >= NumWarmupFrames)
+				{
+					total.submitMs += times.submitMs;
+					total.gpuMs += times.gpuMs;
+				}
+			}
+			PrintCrowdTimes("baked", count, total, NumFrames);
+			std::cout << "  baked " << count << " once: pack " << packMs << " ms, upload " << uploadMs << " ms" << std::endl;
+		}
+
+		// a draw per mesh per character is only worth waiting for on the smaller crowds
+		if (count > MaxPerCharacterCount)
+			continue;
+		UniformRing ring(count * UniformRing::GetAlignedSize<CharacterBlock>());
+		CharacterBlock block;
+		block.SetPalette(palette);
+		total = CrowdFrameTimes();
+		std::vector<GLintptr> offsets(count);
+		for (int frame = 0; frame < NumWarmupFrames + NumFrames; frame++)
+		{
+			CrowdFrameTimes times;
+			auto start = std::chrono::high_resolution_clock::now();
+			ring.BeginFrame();
+			for (int i = 0; i < count; i++)
+			{
+				block.model = GetCrowdModelMatrix(i, count);
+				offsets[i] = ring.Push(block);
+			}
+			times.packMs = GetElapsedMs(start);
+			glBeginQuery(GL_TIME_ELAPSED, query);
+			for (int i = 0; i < count; i++)
+			{
+				ring.Bind(CharacterBlockBinding, offsets[i], sizeof(CharacterBlock));
+				model.Draw(variants);
+			}
+			glEndQuery(GL_TIME_ELAPSED);
+			ring.EndFrame();
+			times.submitMs = GetElapsedMs(start);
+			AddGpuTime(query, times);
+			if (frame >= NumWarmupFrames)
+			{
+				total.packMs += times.packMs;
+				total.submitMs += times.submitMs;
+				total.gpuMs += times.gpuMs;
+			}
+		}
+		PrintCrowdTimes("per character", count, total, NumFrames);
+	}
+
+	glDeleteQueries(1, &query);
+	return 0;
+}
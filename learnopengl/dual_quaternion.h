@@ -0,0 +1,80 @@
+#pragma once
+
+/* Dual-quaternion skinning. A bone's rigid transform is a unit dual quaternion, 8 floats instead of a matrix's 16,
+   and vertices blend the dual quaternions of their bones instead of the matrices, which keeps twisting joints from
+   collapsing like linear blending does. Scale can't be represented and is dropped, so rigs that scale bones stay on
+   matrices. The functions here are the CPU reference of the DUAL_QUATERNION variant of anim_model.vs. */
+
+#ifndef GLM_ENABLE_EXPERIMENTAL
+#define GLM_ENABLE_EXPERIMENTAL
+#endif
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtx/dual_quaternion.hpp>
+
+#include <learnopengl/transform.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace DualQuaternion
+{
+	// the rigid part of an affine transform; the basis is orthonormalized first, so scale and shear are lost
+	inline glm::dualquat FromAffine(const glm::mat4x3& m)
+	{
+		glm::vec3 x = glm::normalize(m[0]);
+		glm::vec3 y = glm::normalize(m[1] - x * glm::dot(x, m[1]));
+		glm::vec3 z = glm::cross(x, y);
+		if (glm::dot(z, m[2]) < 0.0f)
+			z = -z;
+		glm::quat rotation = glm::normalize(glm::quat_cast(glm::mat3(x, y, z)));
+		return glm::dualquat(rotation, m[3]);
+	}
+
+	inline glm::dualquat FromMatrix(const glm::mat4& m)
+	{
+		return FromAffine(::ToAffine(m));
+	}
+
+	// rotation and translation of a unit dual quaternion as an affine matrix
+	inline glm::mat4x3 ToAffine(const glm::dualquat& dq)
+	{
+		glm::mat4x3 m = glm::mat4x3(glm::mat3_cast(dq.real));
+		glm::quat t = dq.dual * glm::conjugate(dq.real);
+		m[3] = 2.0f * glm::vec3(t.x, t.y, t.z);
+		return m;
+	}
+
+	// largest factor by which the basis of m departs from a pure rotation, 0 for a rigid transform
+	inline float GetScaleError(const glm::mat4x3& m)
+	{
+		return std::max(std::abs(glm::length(m[0]) - 1.0f), std::max(std::abs(glm::length(m[1]) - 1.0f), std::abs(glm::length(m[2]) - 1.0f)));
+	}
+
+	// weighted sum of count bones' dual quaternions, normalized. Each is flipped onto the first's hemisphere first:
+	// q and -q are the same rotation, but summed they'd cancel
+	inline glm::dualquat Blend(const glm::dualquat* palette, const int* ids, const float* weights, int count)
+	{
+		glm::dualquat pivot = palette[std::max(ids[0], 0)];
+		glm::dualquat sum(glm::quat(0.0f, 0.0f, 0.0f, 0.0f), glm::quat(0.0f, 0.0f, 0.0f, 0.0f));
+		for (int i = 0; i < count; i++)
+		{
+			const glm::dualquat& dq = palette[std::max(ids[i], 0)];
+			float weight = glm::dot(pivot.real, dq.real) < 0.0f ? -weights[i] : weights[i];
+			sum.real = sum.real + dq.real * weight;
+			sum.dual = sum.dual + dq.dual * weight;
+		}
+		float length = glm::length(sum.real);
+		if (length <= 0.0f)
+			return glm::dualquat(glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.0f));
+		return glm::dualquat(sum.real / length, sum.dual / length);
+	}
+
+	// the palette for the Character block: real part, then dual part, both x y z w
+	inline void Pack(const glm::dualquat& dq, glm::vec4 out[2])
+	{
+		out[0] = glm::vec4(dq.real.x, dq.real.y, dq.real.z, dq.real.w);
+		out[1] = glm::vec4(dq.dual.x, dq.dual.y, dq.dual.z, dq.dual.w);
+	}
+}
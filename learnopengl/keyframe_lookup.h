@@ -0,0 +1,36 @@
+#pragma once
+
+/* Keyframe lookup with a cached playback cursor per track */
+
+#include <algorithm>
+
+// Returns the index i of the key pair [i, i + 1] that brackets animationTime, clamped to [0, numKeys - 2].
+// The cursor remembers the last result: during monotonic playback the answer is the same key or one of
+// the next few, so the lookup is amortized O(1). Seeks and loop wraps fall back to a binary search.
+inline int FindKeyIndex(const float* times, int numKeys, float animationTime, int& cursor)
+{
+	const int lastPair = numKeys - 2;
+	if (lastPair <= 0)
+		return 0;
+
+	const int MaxForwardSteps = 4;
+	int index = std::min(std::max(cursor, 0), lastPair);
+	if (animationTime >= times[index])
+	{
+		for (int step = 0; step < MaxForwardSteps; ++step)
+		{
+			if (index == lastPair || animationTime < times[index + 1])
+			{
+				cursor = index;
+				return index;
+			}
+			++index;
+		}
+	}
+
+	// first key after animationTime, searched over keys [1, numKeys - 1]
+	const float* next = std::upper_bound(times + 1, times + numKeys, animationTime);
+	index = std::min(static_cast<int>(next - times) - 1, lastPair);
+	cursor = index;
+	return index;
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+/* Read-only memory mapping of a whole file, used to read cooked assets in place */
+
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+// glad.h defines APIENTRY as __stdcall and windows.h would redefine it as WINAPI (C4005), keep glad's
+#pragma push_macro("APIENTRY")
+#undef APIENTRY
+#include <windows.h>
+#pragma pop_macro("APIENTRY")
+#include <direct.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// size and modification time of a file, compared against the stamp stored in a cooked file to detect stale data
+struct FileStamp
+{
+	bool exists = false;
+	uint64_t size = 0;
+	int64_t time = 0;
+
+	bool operator==(const FileStamp& other) const { return exists == other.exists && size == other.size && time == other.time; }
+	bool operator!=(const FileStamp& other) const { return !(*this == other); }
+};
+
+inline FileStamp GetFileStamp(const std::string& path)
+{
+	FileStamp stamp;
+#ifdef _WIN32
+	struct _stat64 info;
+	if (_stat64(path.c_str(), &info) != 0)
+		return stamp;
+#else
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0)
+		return stamp;
+#endif
+	stamp.exists = true;
+	stamp.size = static_cast<uint64_t>(info.st_size);
+	stamp.time = static_cast<int64_t>(info.st_mtime);
+	return stamp;
+}
+
+// creates the directory path unless it exists, its parent has to; false if it still isn't there
+inline bool MakeDirectory(const std::string& path)
+{
+#ifdef _WIN32
+	_mkdir(path.c_str());
+	struct _stat64 info;
+	return _stat64(path.c_str(), &info) == 0 && (info.st_mode & _S_IFDIR);
+#else
+	mkdir(path.c_str(), 0755);
+	struct stat info;
+	return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+#endif
+}
+
+class MappedFile
+{
+public:
+	MappedFile() = default;
+
+	~MappedFile()
+	{
+		Close();
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool Open(const std::string& path)
+	{
+		Close();
+#ifdef _WIN32
+		m_File = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (m_File == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(m_File, &size) || size.QuadPart == 0)
+		{
+			Close();
+			return false;
+		}
+		m_Mapping = CreateFileMappingA(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!m_Mapping)
+		{
+			Close();
+			return false;
+		}
+		m_Data = static_cast<const unsigned char*>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+		m_Size = static_cast<size_t>(size.QuadPart);
+#else
+		m_File = open(path.c_str(), O_RDONLY);
+		if (m_File < 0)
+			return false;
+		struct stat info;
+		if (fstat(m_File, &info) != 0 || info.st_size == 0)
+		{
+			Close();
+			return false;
+		}
+		void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, m_File, 0);
+		m_Data = data != MAP_FAILED ? static_cast<const unsigned char*>(data) : nullptr;
+		m_Size = static_cast<size_t>(info.st_size);
+#endif
+		if (!m_Data)
+		{
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	void Close()
+	{
+#ifdef _WIN32
+		if (m_Data)
+			UnmapViewOfFile(m_Data);
+		if (m_Mapping)
+			CloseHandle(m_Mapping);
+		if (m_File != INVALID_HANDLE_VALUE)
+			CloseHandle(m_File);
+		m_Mapping = nullptr;
+		m_File = INVALID_HANDLE_VALUE;
+#else
+		if (m_Data)
+			munmap(const_cast<unsigned char*>(m_Data), m_Size);
+		if (m_File >= 0)
+			close(m_File);
+		m_File = -1;
+#endif
+		m_Data = nullptr;
+		m_Size = 0;
+	}
+
+	inline bool IsOpen() const { return m_Data != nullptr; }
+	inline const unsigned char* GetData() const { return m_Data; }
+	inline size_t GetSize() const { return m_Size; }
+
+private:
+#ifdef _WIN32
+	HANDLE m_File = INVALID_HANDLE_VALUE;
+	HANDLE m_Mapping = nullptr;
+#else
+	int m_File = -1;
+#endif
+	const unsigned char* m_Data = nullptr;
+	size_t m_Size = 0;
+};
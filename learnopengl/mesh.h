@@ -7,7 +7,10 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <learnopengl/shader.h>
+#include <learnopengl/vertex_packing.h>
 
+#include <algorithm>
+#include <memory>
 #include <string>
 #include <vector>
 using namespace std;
@@ -31,12 +34,75 @@ struct Vertex {
     float m_Weights[MAX_BONE_INFLUENCE];
 };
 
+// per-instance attributes of the instanced draws, see SkinnedCrowd
+struct MeshInstance {
+    // first palette entry of the instance, its model matrix (location 7)
+    int paletteBase;
+    // baked clip it plays or -1 (location 8), see BakedAnimation
+    int clip;
+    // seconds its clip runs ahead of the crowd (location 9)
+    float timeOffset;
+};
+
 struct Texture {
     unsigned int id;
     string type;
     string path;
 };
 
+// a material texture of a mesh that is not uploaded yet: which of its model's textures and the sampler type it binds as
+struct MeshTextureRef {
+    int texture;
+    string type;
+    string path;
+};
+
+// CPU side of a mesh, built without any GL call so it can be done on a loader thread. The vertices and indices
+// are its own vectors, or live in a mapped cooked file when owner is set
+struct MeshData {
+    vector<Vertex>         vertices;
+    vector<unsigned int>   indices;
+    vector<MeshTextureRef> textures;
+    // skeleton bone of each entry of a partitioned mesh's local palette, empty when its vertices use skeleton bone ids
+    vector<int>            bones;
+
+    std::shared_ptr<const void> owner;
+    const Vertex* vertexData = nullptr;
+    const unsigned int* indexData = nullptr;
+    unsigned int numVertices = 0;
+    unsigned int numIndices = 0;
+
+    const Vertex* GetVertices() const { return owner ? vertexData : vertices.data(); }
+    unsigned int GetNumVertices() const { return owner ? numVertices : static_cast<unsigned int>(vertices.size()); }
+    const unsigned int* GetIndices() const { return owner ? indexData : indices.data(); }
+    unsigned int GetNumIndices() const { return owner ? numIndices : static_cast<unsigned int>(indices.size()); }
+};
+
+// the GPU copy of vertices in the packed layout, wide when a bone id doesn't fit a byte
+inline PackedVertices PackVertices(const Vertex* vertices, unsigned int numVertices)
+{
+    PackedVertices packed;
+    int maxBoneID = 0;
+    for (unsigned int i = 0; i < numVertices; i++)
+        for (int j = 0; j < MAX_BONE_INFLUENCE; j++)
+            maxBoneID = std::max(maxBoneID, vertices[i].m_BoneIDs[j]);
+    packed.format = maxBoneID < 256 ? VertexFormatPacked : VertexFormatPackedWide;
+
+    size_t stride = packed.format == VertexFormatPacked ? sizeof(PackedVertex) : sizeof(PackedVertexWide);
+    packed.data.resize(numVertices * stride);
+    for (unsigned int i = 0; i < numVertices; i++)
+    {
+        const Vertex& v = vertices[i];
+        if (packed.format == VertexFormatPacked)
+            VertexPacking::PackVertex(v.Position, v.Normal, v.TexCoords, v.Tangent, v.Bitangent, v.m_BoneIDs, v.m_Weights, MAX_BONE_INFLUENCE,
+                reinterpret_cast<PackedVertex*>(packed.data.data())[i]);
+        else
+            VertexPacking::PackVertex(v.Position, v.Normal, v.TexCoords, v.Tangent, v.Bitangent, v.m_BoneIDs, v.m_Weights, MAX_BONE_INFLUENCE,
+                reinterpret_cast<PackedVertexWide*>(packed.data.data())[i]);
+    }
+    return packed;
+}
+
 class Mesh {
 public:
     // mesh Data
@@ -48,16 +114,112 @@ public:
     // constructor
     Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        setupMesh(this->vertices.data(), static_cast<unsigned int>(this->vertices.size()),
+            this->indices.data(), static_cast<unsigned int>(this->indices.size()));
+    }
+
+    // constructor over vertex and index data that lives elsewhere, e.g. in a mapped cooked file. It is uploaded
+    // from there and the vectors stay empty; owner keeps the data alive for GetVertices()/GetIndices()
+    Mesh(const Vertex* vertexData, unsigned int numVertices, const unsigned int* indexData, unsigned int numIndices,
+        vector<Texture> textures, std::shared_ptr<const void> owner)
+    {
+        this->textures = std::move(textures);
+        m_Owner = std::move(owner);
+        m_VertexData = vertexData;
+        m_IndexData = indexData;
+        m_NumVertices = numVertices;
+        m_NumIndices = numIndices;
+        setupMesh(vertexData, numVertices, indexData, numIndices);
+    }
+
+    // uploads data in place, the mesh keeps it alive
+    Mesh(std::shared_ptr<const MeshData> data, vector<Texture> textures)
+        : Mesh(data->GetVertices(), data->GetNumVertices(), data->GetIndices(), data->GetNumIndices(), std::move(textures), data)
+    {
+    }
+
+    // same, but the GPU gets packed in place of data's vertices, which stay the CPU copy
+    Mesh(std::shared_ptr<const MeshData> data, vector<Texture> textures, const PackedVertices& packed)
+    {
+        this->textures = std::move(textures);
+        m_Owner = data;
+        m_VertexData = data->GetVertices();
+        m_IndexData = data->GetIndices();
+        m_NumVertices = data->GetNumVertices();
+        m_NumIndices = data->GetNumIndices();
+        setupMesh(m_VertexData, m_NumVertices, m_IndexData, m_NumIndices, &packed);
+    }
+
+    // the mesh data whichever constructor built it
+    const Vertex* GetVertices() const { return m_Owner ? m_VertexData : vertices.data(); }
+    unsigned int GetNumVertices() const { return m_Owner ? m_NumVertices : static_cast<unsigned int>(vertices.size()); }
+    const unsigned int* GetIndices() const { return m_Owner ? m_IndexData : indices.data(); }
+    unsigned int GetNumIndices() const { return m_Owner ? m_NumIndices : static_cast<unsigned int>(indices.size()); }
+
+    // layout of the vertex buffer, decides the shader variant's PACKED_VERTEX
+    VertexFormat GetVertexFormat() const { return m_VertexFormat; }
+
+    // most bones any vertex is weighted to, 0 when the mesh isn't skinned
+    int GetNumInfluences() const { return m_NumInfluences; }
+
+    bool HasTexture(const string& type) const
+    {
+        for (const Texture& texture : textures)
+            if (texture.type == type)
+                return true;
+        return false;
     }
 
     // render the mesh
     void Draw(Shader& shader)
+    {
+        bindTextures(shader);
+
+        // draw mesh
+        glBindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, GetNumIndices(), m_IndexType, 0);
+        glBindVertexArray(0);
+
+        // always good practice to set everything back to defaults once configured.
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // render count instances of the mesh, see SetInstanceBuffer
+    void DrawInstanced(Shader& shader, int count)
+    {
+        bindTextures(shader);
+        glBindVertexArray(VAO);
+        glDrawElementsInstanced(GL_TRIANGLES, GetNumIndices(), m_IndexType, 0, count);
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // feeds attributes 7 to 9 one MeshInstance per instance from buffer. Set again before every DrawInstanced: a
+    // deleted buffer's name comes back for the next one, so the VAO's binding can't be told apart by name
+    void SetInstanceBuffer(GLuint buffer)
+    {
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glEnableVertexAttribArray(7);
+        glVertexAttribIPointer(7, 1, GL_INT, sizeof(MeshInstance), (void*)offsetof(MeshInstance, paletteBase));
+        glVertexAttribDivisor(7, 1);
+        glEnableVertexAttribArray(8);
+        glVertexAttribIPointer(8, 1, GL_INT, sizeof(MeshInstance), (void*)offsetof(MeshInstance, clip));
+        glVertexAttribDivisor(8, 1);
+        glEnableVertexAttribArray(9);
+        glVertexAttribPointer(9, 1, GL_FLOAT, GL_FALSE, sizeof(MeshInstance), (void*)offsetof(MeshInstance, timeOffset));
+        glVertexAttribDivisor(9, 1);
+        glBindVertexArray(0);
+    }
+
+private:
+    // binds the mesh's textures to units 0 and up, named for the shader as texture_diffuseN and so on
+    void bindTextures(Shader& shader)
     {
         // bind appropriate textures
         unsigned int diffuseNr = 1;
@@ -80,28 +242,35 @@ public:
                 number = std::to_string(heightNr++); // transfer unsigned int to string
 
             // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
+            shader.setInt(name + number, i);
             // and finally bind the texture
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
         }
-
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
     }
 
-
-private:
     // render data 
     unsigned int VBO, EBO;
 
-    // initializes all the buffer objects/arrays
-    void setupMesh()
+    // mapped mesh data, see the second constructor
+    std::shared_ptr<const void> m_Owner;
+    const Vertex* m_VertexData = nullptr;
+    const unsigned int* m_IndexData = nullptr;
+    unsigned int m_NumVertices = 0;
+    unsigned int m_NumIndices = 0;
+    int m_NumInfluences = 0;
+    VertexFormat m_VertexFormat = VertexFormatFull;
+    GLenum m_IndexType = GL_UNSIGNED_INT;
+
+    // initializes all the buffer objects/arrays, from packed instead of vertexData when given
+    void setupMesh(const Vertex* vertexData, unsigned int numVertices, const unsigned int* indexData, unsigned int numIndices,
+        const PackedVertices* packed = nullptr)
     {
+        // bone slots fill from the front, so the last used slot of a vertex is its influence count
+        for (unsigned int i = 0; i < numVertices; i++)
+            for (int j = m_NumInfluences; j < MAX_BONE_INFLUENCE; j++)
+                if (vertexData[i].m_BoneIDs[j] >= 0)
+                    m_NumInfluences = j + 1;
+
         // create buffers/arrays
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
@@ -110,13 +279,24 @@ private:
         glBindVertexArray(VAO);
         // load data into vertex buffers
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        if (packed && packed->format != VertexFormatFull)
+        {
+            m_VertexFormat = packed->format;
+            glBufferData(GL_ARRAY_BUFFER, packed->data.size(), packed->data.data(), GL_STATIC_DRAW);
+            uploadIndices(indexData, numIndices, numVertices);
+            if (m_VertexFormat == VertexFormatPacked)
+                setupPackedAttributes<PackedVertex>(GL_UNSIGNED_BYTE);
+            else
+                setupPackedAttributes<PackedVertexWide>(GL_UNSIGNED_SHORT);
+            glBindVertexArray(0);
+            return;
+        }
         // A great thing about structs is that their memory layout is sequential for all its items.
         // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
         // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof(Vertex), vertexData, GL_STATIC_DRAW);
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        uploadIndices(indexData, numIndices, numVertices);
 
         // set the vertex attribute pointers
         // vertex Positions
@@ -143,5 +323,41 @@ private:
         glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
         glBindVertexArray(0);
     }
+
+    // the element buffer, as 16 bit indices when every vertex can be addressed with them. The CPU copy stays 32 bit
+    void uploadIndices(const unsigned int* indexData, unsigned int numIndices, unsigned int numVertices)
+    {
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        if (numVertices <= 65536)
+        {
+            vector<unsigned short> shortIndices(indexData, indexData + numIndices);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof(unsigned short), shortIndices.data(), GL_STATIC_DRAW);
+            m_IndexType = GL_UNSIGNED_SHORT;
+        }
+        else
+        {
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof(unsigned int), indexData, GL_STATIC_DRAW);
+            m_IndexType = GL_UNSIGNED_INT;
+        }
+    }
+
+    // attributes of a packed layout, the bone ids and weights being of boneType; the bitangent is rebuilt in the shader
+    template<typename P>
+    void setupPackedAttributes(GLenum boneType)
+    {
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(P), (void*)offsetof(P, Position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(P), (void*)offsetof(P, Normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(P), (void*)offsetof(P, TexCoords));
+        // kept integer so the shader can read the handedness bit
+        glEnableVertexAttribArray(3);
+        glVertexAttribIPointer(3, 2, GL_SHORT, sizeof(P), (void*)offsetof(P, Tangent));
+        glEnableVertexAttribArray(5);
+        glVertexAttribIPointer(5, 4, boneType, sizeof(P), (void*)offsetof(P, BoneIDs));
+        glEnableVertexAttribArray(6);
+        glVertexAttribPointer(6, 4, boneType, GL_TRUE, sizeof(P), (void*)offsetof(P, Weights));
+    }
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,332 @@
+#pragma once
+
+/* Optimization of imported triangle lists, run once per mesh after import (and so baked into cooked files):
+   welds identical vertices, reorders triangles for the post-transform vertex cache with Tipsify (Sander, Nehab and
+   Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"), sorts the resulting clusters so
+   outward-facing ones come first, then renumbers vertices in first-use order for fetch locality.
+   ACMR is cache misses per triangle (0.5 is about the best a regular grid gets, 3 is no reuse at all);
+   ATVR is misses per vertex (1 means every vertex is transformed once). */
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+// post-transform cache entries the optimizer plans for and the analysis simulates, as a FIFO
+const int MeshOptimizerCacheSize = 16;
+
+struct VertexCacheStats
+{
+	float acmr = 0.0f;
+	float atvr = 0.0f;
+};
+
+struct MeshOptimizeStats
+{
+	unsigned int verticesIn = 0;
+	unsigned int verticesOut = 0;
+	unsigned int triangles = 0;
+	VertexCacheStats before;
+	VertexCacheStats after;
+};
+
+namespace MeshOptimizer
+{
+	// FIFO cache simulation of indices over numVertices vertices
+	inline VertexCacheStats AnalyzeVertexCache(const unsigned int* indices, size_t numIndices, size_t numVertices,
+		int cacheSize = MeshOptimizerCacheSize)
+	{
+		VertexCacheStats stats;
+		if (numIndices < 3 || numVertices == 0)
+			return stats;
+		// a vertex is in the cache while fewer than cacheSize misses happened since it was loaded
+		std::vector<unsigned int> loadedAt(numVertices, 0);
+		unsigned int misses = 0;
+		for (size_t i = 0; i < numIndices; i++)
+		{
+			unsigned int v = indices[i];
+			if (loadedAt[v] == 0 || misses - loadedAt[v] >= static_cast<unsigned int>(cacheSize))
+			{
+				misses++;
+				loadedAt[v] = misses;
+			}
+		}
+		stats.acmr = float(misses) / float(numIndices / 3);
+		std::vector<bool> used(numVertices, false);
+		size_t numUsed = 0;
+		for (size_t i = 0; i < numIndices; i++)
+			if (!used[indices[i]])
+			{
+				used[indices[i]] = true;
+				numUsed++;
+			}
+		stats.atvr = float(misses) / float(numUsed);
+		return stats;
+	}
+
+	// merges bitwise identical vertices, rewriting indices. V must be plain data without padding
+	template<typename V>
+	void WeldVertices(std::vector<V>& vertices, std::vector<unsigned int>& indices)
+	{
+		size_t tableSize = 1;
+		while (tableSize < vertices.size() * 2)
+			tableSize *= 2;
+		const unsigned int empty = ~0u;
+		std::vector<unsigned int> table(tableSize, empty);
+		std::vector<unsigned int> remap(vertices.size());
+		unsigned int numUnique = 0;
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			// FNV-1a over the vertex bytes, linear probing
+			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&vertices[i]);
+			uint64_t hash = 14695981039346656037ull;
+			for (size_t b = 0; b < sizeof(V); b++)
+				hash = (hash ^ bytes[b]) * 1099511628211ull;
+			size_t slot = static_cast<size_t>(hash) & (tableSize - 1);
+			while (table[slot] != empty && std::memcmp(&vertices[table[slot]], &vertices[i], sizeof(V)) != 0)
+				slot = (slot + 1) & (tableSize - 1);
+			if (table[slot] == empty)
+			{
+				vertices[numUnique] = vertices[i];
+				table[slot] = numUnique++;
+			}
+			remap[i] = table[slot];
+		}
+		vertices.resize(numUnique);
+		for (unsigned int& index : indices)
+			index = remap[index];
+	}
+
+	// Tipsify: fans around the most recently cached vertex that still has triangles, falling back to recent
+	// vertices and then to the input order. Returns the reordered indices; clusters receives the first triangle of
+	// every run that started with a cold cache
+	inline std::vector<unsigned int> OptimizeVertexCache(const std::vector<unsigned int>& indices, size_t numVertices,
+		std::vector<unsigned int>& clusters, int cacheSize = MeshOptimizerCacheSize)
+	{
+		size_t numTriangles = indices.size() / 3;
+		std::vector<unsigned int> output;
+		output.reserve(indices.size());
+		clusters.clear();
+
+		// triangles around each vertex
+		std::vector<unsigned int> live(numVertices, 0);
+		for (unsigned int index : indices)
+			live[index]++;
+		std::vector<unsigned int> offsets(numVertices + 1, 0);
+		for (size_t v = 0; v < numVertices; v++)
+			offsets[v + 1] = offsets[v] + live[v];
+		std::vector<unsigned int> adjacency(indices.size());
+		std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); i++)
+			adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+
+		std::vector<int> cacheTime(numVertices, 0);
+		std::vector<bool> emitted(numTriangles, false);
+		std::vector<unsigned int> deadEnd;
+		std::vector<unsigned int> candidates;
+		int time = cacheSize + 1;
+		size_t cursor = 0;
+		int fan = numVertices > 0 ? 0 : -1;
+		bool cold = true;
+
+		while (fan >= 0)
+		{
+			candidates.clear();
+			for (unsigned int a = offsets[fan]; a < offsets[fan + 1]; a++)
+			{
+				unsigned int triangle = adjacency[a];
+				if (emitted[triangle])
+					continue;
+				if (cold)
+				{
+					clusters.push_back(static_cast<unsigned int>(output.size() / 3));
+					cold = false;
+				}
+				for (int k = 0; k < 3; k++)
+				{
+					unsigned int v = indices[triangle * 3 + k];
+					output.push_back(v);
+					deadEnd.push_back(v);
+					candidates.push_back(v);
+					live[v]--;
+					if (time - cacheTime[v] > cacheSize)
+						cacheTime[v] = time++;
+				}
+				emitted[triangle] = true;
+			}
+
+			// the candidate that will still be cached after its remaining triangles, oldest first
+			int best = -1;
+			int bestPriority = -1;
+			for (unsigned int v : candidates)
+			{
+				if (live[v] == 0)
+					continue;
+				int priority = 0;
+				if (time - cacheTime[v] + 2 * static_cast<int>(live[v]) <= cacheSize)
+					priority = time - cacheTime[v];
+				if (priority > bestPriority)
+				{
+					bestPriority = priority;
+					best = static_cast<int>(v);
+				}
+			}
+			if (best < 0)
+			{
+				// dead end: a recent vertex with triangles left, else the next one in input order
+				cold = true;
+				while (!deadEnd.empty() && best < 0)
+				{
+					unsigned int v = deadEnd.back();
+					deadEnd.pop_back();
+					if (live[v] > 0)
+						best = static_cast<int>(v);
+				}
+				while (best < 0 && cursor < numVertices)
+				{
+					if (live[cursor] > 0)
+						best = static_cast<int>(cursor);
+					cursor++;
+				}
+			}
+			fan = best;
+		}
+		return output;
+	}
+
+	// splits the clusters further where the run since the last split already has an ACMR within threshold of the
+	// whole mesh, then orders them so clusters facing away from the mesh centre draw first and hide what's behind
+	template<typename V>
+	void OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<V>& vertices, const std::vector<unsigned int>& clusters,
+		float threshold = 1.05f, int cacheSize = MeshOptimizerCacheSize)
+	{
+		size_t numTriangles = indices.size() / 3;
+		if (numTriangles == 0 || clusters.empty())
+			return;
+		float target = AnalyzeVertexCache(indices.data(), indices.size(), vertices.size(), cacheSize).acmr * threshold;
+
+		// the cache is flushed at each split by forgetting loads from before base
+		std::vector<unsigned int> splits;
+		std::vector<unsigned int> loadedAt(vertices.size(), 0);
+		unsigned int stamp = 0;
+		for (size_t c = 0; c < clusters.size(); c++)
+		{
+			unsigned int end = c + 1 < clusters.size() ? clusters[c + 1] : static_cast<unsigned int>(numTriangles);
+			unsigned int start = clusters[c];
+			unsigned int base = stamp;
+			unsigned int misses = 0;
+			splits.push_back(start);
+			for (unsigned int t = start; t < end; t++)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					unsigned int v = indices[t * 3 + k];
+					if (loadedAt[v] <= base || stamp - loadedAt[v] >= static_cast<unsigned int>(cacheSize))
+					{
+						misses++;
+						loadedAt[v] = ++stamp;
+					}
+				}
+				if (t + 1 < end && float(misses) / float(t + 1 - start) <= target)
+				{
+					start = t + 1;
+					base = stamp;
+					misses = 0;
+					splits.push_back(start);
+				}
+			}
+		}
+
+		// area weighted centroid and normal of each cluster and of the mesh
+		struct Cluster
+		{
+			unsigned int begin, end;
+			glm::vec3 centroid;
+			glm::vec3 normal;
+			float sortKey;
+		};
+		std::vector<Cluster> parts(splits.size());
+		glm::vec3 meshCentroid(0.0f);
+		float meshArea = 0.0f;
+		for (size_t c = 0; c < splits.size(); c++)
+		{
+			Cluster& part = parts[c];
+			part.begin = splits[c];
+			part.end = c + 1 < splits.size() ? splits[c + 1] : static_cast<unsigned int>(numTriangles);
+			part.centroid = glm::vec3(0.0f);
+			part.normal = glm::vec3(0.0f);
+			float area = 0.0f;
+			for (unsigned int t = part.begin; t < part.end; t++)
+			{
+				const glm::vec3& a = vertices[indices[t * 3 + 0]].Position;
+				const glm::vec3& b = vertices[indices[t * 3 + 1]].Position;
+				const glm::vec3& d = vertices[indices[t * 3 + 2]].Position;
+				glm::vec3 n = glm::cross(b - a, d - a);
+				float triangleArea = glm::length(n);
+				part.centroid += (a + b + d) * (triangleArea / 3.0f);
+				part.normal += n;
+				area += triangleArea;
+			}
+			meshCentroid += part.centroid;
+			meshArea += area;
+			part.centroid = area > 0.0f ? part.centroid / area : (vertices[indices[part.begin * 3]].Position);
+			float length = glm::length(part.normal);
+			part.normal = length > 0.0f ? part.normal / length : glm::vec3(0.0f);
+		}
+		if (meshArea > 0.0f)
+			meshCentroid /= meshArea;
+		for (Cluster& part : parts)
+			part.sortKey = glm::dot(part.centroid - meshCentroid, part.normal);
+		std::stable_sort(parts.begin(), parts.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+		std::vector<unsigned int> sorted;
+		sorted.reserve(indices.size());
+		for (const Cluster& part : parts)
+			sorted.insert(sorted.end(), indices.begin() + part.begin * 3, indices.begin() + part.end * 3);
+		indices.swap(sorted);
+	}
+
+	// renumbers vertices in the order the indices first use them, dropping unused ones
+	template<typename V>
+	void OptimizeVertexFetch(std::vector<V>& vertices, std::vector<unsigned int>& indices)
+	{
+		const unsigned int unused = ~0u;
+		std::vector<unsigned int> remap(vertices.size(), unused);
+		std::vector<V> ordered;
+		ordered.reserve(vertices.size());
+		for (unsigned int& index : indices)
+		{
+			if (remap[index] == unused)
+			{
+				remap[index] = static_cast<unsigned int>(ordered.size());
+				ordered.push_back(vertices[index]);
+			}
+			index = remap[index];
+		}
+		vertices.swap(ordered);
+	}
+
+	// the whole pass on a triangle list; anything else (points, lines) is left as it is
+	template<typename V>
+	MeshOptimizeStats OptimizeMesh(std::vector<V>& vertices, std::vector<unsigned int>& indices)
+	{
+		MeshOptimizeStats stats;
+		stats.verticesIn = static_cast<unsigned int>(vertices.size());
+		stats.triangles = static_cast<unsigned int>(indices.size() / 3);
+		stats.before = AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+		if (indices.size() % 3 == 0 && !indices.empty())
+		{
+			WeldVertices(vertices, indices);
+			std::vector<unsigned int> clusters;
+			indices = OptimizeVertexCache(indices, vertices.size(), clusters);
+			OptimizeOverdraw(indices, vertices, clusters);
+			OptimizeVertexFetch(vertices, indices);
+		}
+		stats.verticesOut = static_cast<unsigned int>(vertices.size());
+		stats.after = AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+		return stats;
+	}
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+/* Splitting skinned meshes by the bones they use, run after import so each draw only needs the matrices of a few
+   bones. Triangles are taken in their optimized order and packed greedily into partitions of at most maxBones
+   distinct bones; each partition becomes a mesh of its own whose vertices index a local palette, with MeshData::bones
+   mapping that palette back to skeleton bones. Vertices on a partition border are duplicated. */
+
+#include <learnopengl/mesh.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+struct MeshPartitionStats
+{
+	int partitions = 0;
+	int largestPalette = 0;
+	std::vector<int> paletteSizes;	// bones of each partition's draw, in order
+	unsigned int verticesIn = 0;
+	unsigned int verticesOut = 0;
+};
+
+namespace MeshPartition
+{
+	// every triangle's bones fit a partition however they are spread
+	const int MinBonesPerPartition = 3 * MAX_BONE_INFLUENCE;
+
+	// the partitions of mesh, each with at most maxBones bones. A mesh without bones comes back as it is
+	inline std::vector<std::shared_ptr<const MeshData>> PartitionMesh(const std::shared_ptr<const MeshData>& mesh, int maxBones,
+		MeshPartitionStats& stats)
+	{
+		maxBones = std::max(maxBones, MinBonesPerPartition);
+		const Vertex* vertices = mesh->GetVertices();
+		const unsigned int* indices = mesh->GetIndices();
+		unsigned int numVertices = mesh->GetNumVertices();
+		unsigned int numTriangles = mesh->GetNumIndices() / 3;
+		stats.verticesIn = numVertices;
+
+		int numBones = 0;
+		for (unsigned int i = 0; i < numVertices; i++)
+			for (int j = 0; j < MAX_BONE_INFLUENCE; j++)
+				numBones = std::max(numBones, vertices[i].m_BoneIDs[j] + 1);
+		if (numBones == 0)
+		{
+			stats.partitions = 1;
+			stats.paletteSizes.assign(1, 0);
+			stats.verticesOut = numVertices;
+			return { mesh };
+		}
+
+		// slot of each bone and vertex in the partition being filled, valid while its stamp is the partition's
+		std::vector<int> boneSlot(numBones), boneStamp(numBones, -1);
+		std::vector<unsigned int> vertexSlot(numVertices);
+		std::vector<int> vertexStamp(numVertices, -1);
+		std::vector<unsigned int> remaining(numTriangles), deferred;
+		for (unsigned int t = 0; t < numTriangles; t++)
+			remaining[t] = t;
+
+		std::vector<std::shared_ptr<const MeshData>> partitions;
+		for (int partition = 0; !remaining.empty(); partition++)
+		{
+			auto data = std::make_shared<MeshData>();
+			data->textures = mesh->textures;
+			deferred.clear();
+			for (unsigned int t : remaining)
+			{
+				// the bones the triangle would add
+				int added[MinBonesPerPartition];
+				int numAdded = 0;
+				for (int k = 0; k < 3; k++)
+				{
+					const Vertex& vertex = vertices[indices[3 * t + k]];
+					for (int j = 0; j < MAX_BONE_INFLUENCE; j++)
+					{
+						int bone = vertex.m_BoneIDs[j];
+						if (bone < 0 || vertex.m_Weights[j] <= 0.0f || boneStamp[bone] == partition
+							|| std::find(added, added + numAdded, bone) != added + numAdded)
+							continue;
+						added[numAdded++] = bone;
+					}
+				}
+				if (static_cast<int>(data->bones.size()) + numAdded > maxBones)
+				{
+					deferred.push_back(t);
+					continue;
+				}
+				for (int b = 0; b < numAdded; b++)
+				{
+					boneStamp[added[b]] = partition;
+					boneSlot[added[b]] = static_cast<int>(data->bones.size());
+					data->bones.push_back(added[b]);
+				}
+				for (int k = 0; k < 3; k++)
+				{
+					unsigned int index = indices[3 * t + k];
+					if (vertexStamp[index] != partition)
+					{
+						vertexStamp[index] = partition;
+						vertexSlot[index] = static_cast<unsigned int>(data->vertices.size());
+						Vertex vertex = vertices[index];
+						for (int j = 0; j < MAX_BONE_INFLUENCE; j++)
+						{
+							int bone = vertex.m_BoneIDs[j];
+							bool used = bone >= 0 && vertex.m_Weights[j] > 0.0f;
+							vertex.m_BoneIDs[j] = used ? boneSlot[bone] : -1;
+							vertex.m_Weights[j] = used ? vertex.m_Weights[j] : 0.0f;
+						}
+						data->vertices.push_back(vertex);
+					}
+					data->indices.push_back(vertexSlot[index]);
+				}
+			}
+			std::swap(remaining, deferred);
+
+			int paletteSize = static_cast<int>(data->bones.size());
+			stats.largestPalette = std::max(stats.largestPalette, paletteSize);
+			stats.paletteSizes.push_back(paletteSize);
+			stats.verticesOut += static_cast<unsigned int>(data->vertices.size());
+			partitions.push_back(data);
+		}
+		stats.partitions = static_cast<int>(partitions.size());
+		return partitions;
+	}
+}
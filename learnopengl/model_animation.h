@@ -12,15 +12,30 @@
 
 #include <learnopengl/mesh.h>
 #include <learnopengl/shader.h>
+#include <learnopengl/shader_variants.h>
 
+#include <algorithm>
+#include <chrono>
+#include <functional>
 #include <string>
 #include <fstream>
+#include <iterator>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <vector>
 #include <learnopengl/assimp_glm_helpers.h>
 #include <learnopengl/animdata.h>
+#include <learnopengl/cooked_mesh.h>
+#include <learnopengl/mesh_optimizer.h>
+#include <learnopengl/mesh_partition.h>
+#include <learnopengl/cooked_texture.h>
+#include <learnopengl/mapped_file.h>
+#include <learnopengl/skeleton.h>
+#include <learnopengl/texture_cache.h>
+#include <learnopengl/thread_pool.h>
+#include <learnopengl/transform.h>
 
 using namespace std;
 
@@ -31,14 +46,109 @@ public:
 	vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
 	vector<Mesh>    meshes;
 	string directory;
-	bool gammaCorrection;
+	bool gammaCorrection = false;
+	bool packVertices = true;	// upload PackedVertex buffers instead of Vertex, set before Prepare()
+	int maxBonesPerDraw = 0;	// split meshes so none needs more bones, drawn with DrawPartitioned(); 0 keeps them whole. Set before Prepare()
 
+	// post-processing every import of a model file uses, so animations can be read from the same scene
+	static const unsigned int ImportFlags = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace;
 
 
-	// constructor, expects a filepath to a 3D model.
+	// empty model for Prepare() and Upload(), so the two halves of loading can run on different threads
+	Model() = default;
+
+	// constructor, expects a filepath to a 3D model. An up to date cooked file next to it is mapped instead of importing it.
 	Model(string const& path, bool gamma = false) : gammaCorrection(gamma)
 	{
-		loadModel(path);
+		Prepare(path);
+		Upload();
+	}
+
+	// same, but the Assimp import is left to import() so the caller can share the scene with the file's animations
+	Model(string const& path, const std::function<const aiScene*()>& import, bool gamma = false) : gammaCorrection(gamma)
+	{
+		Prepare(path, import);
+		Upload();
+	}
+
+	// constructor from a scene already imported with ImportFlags, path is the file it came from
+	Model(const aiScene* scene, string const& path, bool gamma = false) : gammaCorrection(gamma)
+	{
+		loadScene(scene, path);
+		Upload();
+	}
+
+	// CPU half of loading: maps the cooked file or imports path (through import() when given), builds the vertices,
+	// bone weights and skeleton and decodes the textures. Makes no GL calls, so it may run on any thread
+	bool Prepare(string const& path, const std::function<const aiScene*()>& import = nullptr)
+	{
+		bool loaded = loadCooked(path);
+		if (!loaded && !import)
+			loaded = loadModel(path);
+		else if (!loaded)
+		{
+			const aiScene* scene = import();
+			if (!scene)
+				return false;
+			loadScene(scene, path);
+			loaded = true;
+		}
+		if (loaded && maxBonesPerDraw > 0)
+			partitionMeshes();
+		return loaded;
+	}
+
+	// GL half: creates the textures and meshes Prepare() left, on the thread owning the context
+	void Upload()
+	{
+		for (auto& task : GetUploadTasks())
+			task();
+	}
+
+	// Upload() as one task per texture and mesh, to be run in order on the context thread, e.g. from an UploadQueue
+	// a few per frame. The model must stay alive and otherwise untouched until the last one has run
+	vector<std::function<void()>> GetUploadTasks()
+	{
+		vector<std::function<void()>> tasks;
+		for (size_t i = 0; i < m_PendingTextures.size(); i++)
+		{
+			tasks.push_back([this, i]()
+			{
+				PendingTexture& pending = m_PendingTextures[i];
+				pending.id = UploadTexture(pending);
+				Texture texture;
+				texture.id = pending.id;
+				texture.type = pending.type;
+				texture.path = pending.path;
+				textures_loaded.push_back(texture);
+			});
+		}
+		for (size_t i = 0; i < m_MeshData.size(); i++)
+		{
+			tasks.push_back([this, i]()
+			{
+				vector<Texture> textures;
+				for (const MeshTextureRef& ref : m_MeshData[i]->textures)
+					textures.push_back({ m_PendingTextures[ref.texture].id, ref.type, ref.path });
+				if (i < m_PackedVertices.size())
+				{
+					meshes.push_back(Mesh(m_MeshData[i], std::move(textures), m_PackedVertices[i]));
+					m_PackedVertices[i] = PackedVertices();
+				}
+				else
+					meshes.push_back(Mesh(m_MeshData[i], std::move(textures)));
+			});
+		}
+		tasks.push_back([this]()
+		{
+			for (PendingTexture& pending : m_PendingTextures)
+				if (pending.texture)
+					m_Textures.push_back(pending.texture);
+			m_PendingTextures.clear();
+			m_PendingIndex.clear();
+			m_PackedVertices.clear();
+		});
+		return tasks;
 	}
 
 	// draws the model, and thus all its meshes
@@ -48,55 +158,427 @@ public:
 			meshes[i].Draw(shader);
 	}
 
+	// draws every mesh with the variant of variants its bone weights and textures call for, the other
+	// features as given. The bones come from the Character block, whose features.paletteSize bones are checked
+	// against the meshes' the first time that size is drawn
+	void Draw(ShaderVariants& variants, ShaderFeatures features = ShaderFeatures())
+	{
+		features.instanced = false;
+		features.localPalette = false;
+		if (features.paletteSize != m_CheckedPaletteSize)
+		{
+			CheckBoneCapacity(features.paletteSize, "Character block");
+			m_CheckedPaletteSize = features.paletteSize;
+		}
+		drawMeshes(variants, features, 0, 0, nullptr);
+	}
+
+	// draws a model split by maxBonesPerDraw, setting each mesh's few matrices of palette before its draw. The model
+	// matrix still comes from the Character block
+	void DrawPartitioned(ShaderVariants& variants, const std::vector<glm::mat4>& palette, ShaderFeatures features = ShaderFeatures())
+	{
+		features.instanced = false;
+		features.localPalette = true;
+		features.paletteSize = GetMaxBonesPerDraw();
+		drawMeshes(variants, features, 0, 0, &palette);
+	}
+
+	// draws count instances of every mesh in one call each, their model matrices and palettes starting at the entries
+	// instanceBuffer holds, see SkinnedCrowd
+	void DrawInstanced(ShaderVariants& variants, GLuint instanceBuffer, int count, ShaderFeatures features = ShaderFeatures())
+	{
+		if (count <= 0)
+			return;
+		features.instanced = true;
+		features.localPalette = false;
+		drawMeshes(variants, features, instanceBuffer, count, nullptr);
+	}
+
+	// bones the largest mesh palette may hold after partitioning, 0 when the meshes are whole
+	int GetMaxBonesPerDraw() const { return maxBonesPerDraw > 0 ? std::max(maxBonesPerDraw, MeshPartition::MinBonesPerPartition) : 0; }
+	bool IsPartitioned() const { return m_Partitioned; }
+
+	const std::map<string, BoneInfo>& GetBoneInfoMap() const { return m_BoneInfoMap; }
+	int GetBoneCount() const { return m_BoneCounter; }
+
+	// warns about every mesh weighted to bones a palette of capacity bones doesn't hold, which would stay in bind pose;
+	// returns how many there are
+	int CheckBoneCapacity(int capacity, const string& palette) const
+	{
+		int over = 0;
+		for (size_t i = 0; i < m_MeshData.size(); i++)
+		{
+			const Vertex* vertices = m_MeshData[i]->GetVertices();
+			int maxBone = -1;
+			for (unsigned int v = 0; v < m_MeshData[i]->GetNumVertices(); v++)
+				for (int j = 0; j < MAX_BONE_INFLUENCE; j++)
+					maxBone = std::max(maxBone, vertices[v].m_BoneIDs[j]);
+			for (int bone : m_MeshData[i]->bones)
+				maxBone = std::max(maxBone, bone);
+			if (maxBone >= capacity)
+			{
+				std::cout << "WARNING::MODEL:: mesh " << i << " references bone " << maxBone << ", the " << palette << " holds " << capacity
+					<< " bones" << std::endl;
+				over++;
+			}
+		}
+		return over;
+	}
+	std::shared_ptr<const Skeleton> GetSkeleton() const { return m_Skeleton; }
+
+	// CPU side of every mesh, available from Prepare() on whether or not the meshes are uploaded yet
+	const vector<std::shared_ptr<const MeshData>>& GetMeshData() const { return m_MeshData; }
+
+	// writes the cooked file next to path, scene has to be the one the model was built from (embedded textures are read from it)
+	bool Cook(const aiScene* scene, string const& path) const
+	{
+		// the cooked file keeps skeleton bone ids, partitioning runs again after it is mapped
+		if (m_Partitioned)
+		{
+			std::cout << "ERROR::MODEL:: " << path << " is partitioned, cook it with maxBonesPerDraw 0" << std::endl;
+			return false;
+		}
+		std::vector<CookedMeshSource> sources;
+		for (const auto& mesh : m_MeshData)
+			sources.push_back({ mesh->GetVertices(), mesh->GetNumVertices(), mesh->GetIndices(), mesh->GetNumIndices(), &mesh->textures });
+
+		std::vector<CookedEmbeddedSource> embedded;
+		for (unsigned int i = 0; i < scene->mNumTextures; i++)
+		{
+			const aiTexture* texture = scene->mTextures[i];
+			uint32_t size = GetEmbeddedTextureSize(texture);
+			embedded.push_back({ texture->mFilename.C_Str(), reinterpret_cast<const unsigned char*>(texture->pcData), size });
+		}
+
+		string cookedPath = path + CookedMeshExtension;
+		if (!WriteCookedMesh(cookedPath, GetFileStamp(path), sources, embedded, m_BoneInfoMap, *m_Skeleton))
+		{
+			cout << "ERROR::COOK:: could not write " << cookedPath << endl;
+			return false;
+		}
+		cout << "Cooked " << cookedPath << ": " << m_MeshData.size() << " meshes, " << embedded.size() << " embedded textures" << endl;
+		return CookTextures(scene);
+	}
+
+	// compresses every texture the model uses with its mips, see cooked_texture.h. The texture type picks the format
+	bool CookTextures(const aiScene* scene, const TextureCookSettings& settings = TextureCookSettings()) const
+	{
+		bool cooked = true;
+		for (const Texture& texture : textures_loaded)
+		{
+			TextureUsage usage = texture.type == "texture_normal" ? TextureUsageNormal
+				: texture.type == "texture_diffuse" || texture.type.empty() ? TextureUsageColor : TextureUsageData;
+			const aiTexture* embedded = scene->GetEmbeddedTexture(texture.path.c_str());
+			if (embedded)
+			{
+				size_t size = GetEmbeddedTextureSize(embedded);
+				const unsigned char* data = reinterpret_cast<const unsigned char*>(embedded->pcData);
+				string cookedPath = GetEmbeddedCookedPath(directory, HashTextureContents(data, size));
+				cooked = CookTexture(cookedPath, data, size, 0, usage, settings) && cooked;
+				continue;
+			}
 
-	auto& GetBoneInfoMap() { return m_BoneInfoMap; }
-	int& GetBoneCount() { return m_BoneCounter; }
+			string path = directory + '/' + texture.path;
+			std::ifstream file(path, std::ios::binary);
+			std::vector<unsigned char> encoded((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+			FileStamp stamp = GetFileStamp(path);
+			if (encoded.empty() || !stamp.exists)
+			{
+				cout << "ERROR::COOK:: could not read " << path << endl;
+				cooked = false;
+				continue;
+			}
+			cooked = CookTexture(path + CookedTextureExtension, encoded.data(), encoded.size(), stamp.time, usage, settings) && cooked;
+		}
+		return cooked;
+	}
 
 
 private:
 
+	// a texture Prepare() found in the texture cache, in the order textures_loaded gets them. id is set once it is uploaded
+	struct PendingTexture
+	{
+		string type;
+		string path;
+		std::shared_ptr<CachedTexture> texture;	// nullptr if the file couldn't be read
+		unsigned int id = 0;
+	};
+
 	std::map<string, BoneInfo> m_BoneInfoMap;
 	int m_BoneCounter = 0;
+	std::shared_ptr<const Skeleton> m_Skeleton;
+	vector<std::shared_ptr<const MeshData>> m_MeshData;
+	bool m_Partitioned = false;
+	vector<glm::mat4> m_LocalPalette;	// scratch of DrawPartitioned()
+	int m_CheckedPaletteSize = 0;		// palette size Draw() last checked the meshes against
+	vector<PackedVertices> m_PackedVertices;	// GPU copy of each mesh's vertices when packVertices, freed once uploaded
+	vector<PendingTexture> m_PendingTextures;
+	std::map<string, int> m_PendingIndex;	// path to m_PendingTextures index
+	vector<std::shared_ptr<CachedTexture>> m_Textures;	// holds the cache entries textures_loaded uses
 
 	// loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-	void loadModel(string const& path)
+	bool loadModel(string const& path)
 	{
 		// read file via ASSIMP
 		Assimp::Importer importer;
-		const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace);
+		const aiScene* scene = importer.ReadFile(path, ImportFlags);
 		// check for errors
 		if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
 		{
 			cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-			return;
+			return false;
 		}
+		loadScene(scene, path);
+		return true;
+	}
+
+	// maps the cooked file of path, its meshes are uploaded straight from the mapping. false if it is missing or stale
+	bool loadCooked(string const& path)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		CookedMeshFile file;
+		if (!file.Open(path + CookedMeshExtension, GetFileStamp(path)))
+			return false;
+		directory = path.substr(0, path.find_last_of('/'));
+
+		for (int i = 0; i < file.GetNumEmbedded(); i++)
+			// typed below by the first mesh texture referring to it, the cooked refs keep processMaterial()'s types
+			LoadEmbeddedTexture(file.GetName(file.GetEmbedded(i).pathOffset), file.GetEmbeddedData(i), file.GetEmbedded(i).size, "");
+
+		m_MeshData.reserve(file.GetNumMeshes());
+		for (int i = 0; i < file.GetNumMeshes(); i++)
+		{
+			const CookedMeshEntry& entry = file.GetMesh(i);
+			auto data = std::make_shared<MeshData>();
+			for (unsigned int t = 0; t < entry.numTextureRefs; t++)
+			{
+				const CookedTextureRef& ref = file.GetTextureRef(i, t);
+				data->textures.push_back(LoadMaterialTexture(file.GetName(ref.pathOffset), file.GetName(ref.typeOffset)));
+			}
+			data->owner = file.GetOwner();
+			data->vertexData = file.GetVertices(i);
+			data->indexData = file.GetIndices(i);
+			data->numVertices = entry.numVertices;
+			data->numIndices = entry.numIndices;
+			m_MeshData.push_back(data);
+		}
+
+		for (int i = 0; i < file.GetNumBones(); i++)
+		{
+			const CookedBone& bone = file.GetBone(i);
+			BoneInfo& info = m_BoneInfoMap[file.GetName(bone.nameOffset)];
+			info.id = bone.id;
+			info.offset = bone.offset;
+			m_BoneCounter = std::max(m_BoneCounter, bone.id + 1);
+		}
+		m_Skeleton = file.ReadSkeleton();
+		int numMeshes = packVertices && maxBonesPerDraw <= 0 ? static_cast<int>(m_MeshData.size()) : 0;
+		m_PackedVertices.resize(numMeshes);
+		GetThreadPool().ParallelFor(numMeshes + static_cast<int>(m_PendingTextures.size()), [&](int i)
+		{
+			if (i < numMeshes)
+				m_PackedVertices[i] = PackVertices(m_MeshData[i]->GetVertices(), m_MeshData[i]->GetNumVertices());
+			else
+				DecodeTexture(m_PendingTextures[i - numMeshes]);
+		});
+
+		auto end = std::chrono::high_resolution_clock::now();
+		cout << "Cooked " << path << CookedMeshExtension << ": " << std::chrono::duration<double, std::milli>(end - start).count()
+			<< " ms, " << m_MeshData.size() << " meshes" << endl;
+		return true;
+	}
+
+	void loadScene(const aiScene* scene, string const& path)
+	{
 		// retrieve the directory path of the filepath
 		directory = path.substr(0, path.find_last_of('/'));
 
 		// process ASSIMP's root node recursively
-		processNode(scene->mRootNode, scene);
+		processMeshes(scene);
+
+		auto skeleton = std::make_shared<Skeleton>();
+		BuildSkeleton(*skeleton, scene->mRootNode, -1);
+		m_Skeleton = skeleton;
+		std::cout << "Skeleton joints: " << skeleton->GetNumJoints() << " palette: " << skeleton->GetPaletteSize() << std::endl;
+	}
+
+	// replaces every mesh by its partitions of at most maxBonesPerDraw bones and packs them
+	void partitionMeshes()
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		ThreadPool& pool = GetThreadPool();
+		vector<vector<std::shared_ptr<const MeshData>>> partitions(m_MeshData.size());
+		vector<MeshPartitionStats> stats(m_MeshData.size());
+		pool.ParallelFor(static_cast<int>(m_MeshData.size()), [&](int i)
+		{
+			partitions[i] = MeshPartition::PartitionMesh(m_MeshData[i], maxBonesPerDraw, stats[i]);
+		});
+
+		m_MeshData.clear();
+		int largest = 0;
+		for (size_t i = 0; i < partitions.size(); i++)
+		{
+			std::cout << "Mesh " << i << ": " << stats[i].partitions << " draws, " << stats[i].verticesIn << " -> " << stats[i].verticesOut
+				<< " vertices, bones per draw:";
+			for (int paletteSize : stats[i].paletteSizes)
+				std::cout << " " << paletteSize;
+			std::cout << std::endl;
+			largest = std::max(largest, stats[i].largestPalette);
+			m_MeshData.insert(m_MeshData.end(), partitions[i].begin(), partitions[i].end());
+		}
+		m_Partitioned = true;
+
+		int numMeshes = packVertices ? static_cast<int>(m_MeshData.size()) : 0;
+		m_PackedVertices.assign(numMeshes, PackedVertices());
+		pool.ParallelFor(numMeshes, [&](int i)
+		{
+			m_PackedVertices[i] = PackVertices(m_MeshData[i]->GetVertices(), m_MeshData[i]->GetNumVertices());
+		});
+
+		auto end = std::chrono::high_resolution_clock::now();
+		std::cout << "Partitioned " << partitions.size() << " meshes into " << m_MeshData.size() << " draws of at most " << GetMaxBonesPerDraw()
+			<< " bones (largest palette " << largest << " of " << m_BoneCounter << "): "
+			<< std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
 	}
 
-	// processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-	void processNode(aiNode* node, const aiScene* scene)
+	void drawMeshes(ShaderVariants& variants, ShaderFeatures features, GLuint instanceBuffer, int instanceCount,
+		const std::vector<glm::mat4>* palette)
 	{
-		// process each mesh located at the current node
+		if (m_Partitioned != features.localPalette)
+		{
+			std::cout << "ERROR::MODEL:: " << (m_Partitioned ? "partitioned meshes are drawn with DrawPartitioned()"
+				: "DrawPartitioned() needs maxBonesPerDraw set before Prepare()") << std::endl;
+			return;
+		}
+		Shader* current = nullptr;
+		for (unsigned int i = 0; i < meshes.size(); i++)
+		{
+			int influences = GetInfluenceVariant(meshes[i].GetNumInfluences());
+			features.skinning = influences > 0;
+			features.influences = std::max(influences, 1);
+			features.normalMap = meshes[i].HasTexture("texture_normal");
+			features.packedVertex = meshes[i].GetVertexFormat() != VertexFormatFull;
+			Shader& shader = variants.Get(features);
+			if (&shader != current)
+			{
+				shader.use();
+				current = &shader;
+			}
+			if (palette && features.skinning)
+				setLocalPalette(shader, *palette, m_MeshData[i]->bones);
+			if (features.instanced)
+			{
+				meshes[i].SetInstanceBuffer(instanceBuffer);
+				meshes[i].DrawInstanced(shader, instanceCount);
+			}
+			else
+				meshes[i].Draw(shader);
+		}
+	}
+
+	// the matrices of palette a partitioned mesh's local palette refers to, identity for bones palette doesn't have
+	void setLocalPalette(Shader& shader, const std::vector<glm::mat4>& palette, const vector<int>& bones)
+	{
+		m_LocalPalette.resize(bones.size());
+		for (size_t i = 0; i < bones.size(); i++)
+			m_LocalPalette[i] = static_cast<size_t>(bones[i]) < palette.size() ? palette[bones[i]] : glm::mat4(1.0f);
+		shader.setMat4Array("localBones", m_LocalPalette);
+	}
+
+	// the joints are the skinned bones and the nodes below them, parents first. Joints no mesh is skinned to
+	// get palette entries after the skinned bones, so clips can still animate them and their children
+	void BuildSkeleton(Skeleton& skeleton, const aiNode* node, int parent)
+	{
+		std::string name = node->mName.C_Str();
+		bool isBone = m_BoneInfoMap.find(name) != m_BoneInfoMap.end();
+		int joint = parent;
+		if (isBone || parent >= 0)
+		{
+			if (node->mNumMeshes > 0 && !isBone)
+				return;
+			if (!isBone)
+			{
+				m_BoneInfoMap[name].id = m_BoneCounter++;
+				m_BoneInfoMap[name].offset = glm::mat4(1.0f);
+			}
+			const BoneInfo& info = m_BoneInfoMap[name];
+			Transform pose = DecomposeTransform(AssimpGLMHelpers::ConvertMatrixToGLMFormat(node->mTransformation));
+			joint = skeleton.AddJoint(name, parent, pose, info.id, ToAffine(info.offset));
+		}
+		for (unsigned int i = 0; i < node->mNumChildren; i++)
+			BuildSkeleton(skeleton, node->mChildren[i], joint);
+	}
+
+	// processes a node in a recursive fashion. Collects each individual mesh located at the node and repeats this process on its children nodes (if any).
+	void processNode(const aiNode* node, const aiScene* scene, vector<const aiMesh*>& order)
+	{
+		// collect each mesh located at the current node
 		for (unsigned int i = 0; i < node->mNumMeshes; i++)
 		{
 			// the node object only contains indices to index the actual objects in the scene. 
 			// the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-			aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-			meshes.push_back(processMesh(mesh, scene));
+			order.push_back(scene->mMeshes[node->mMeshes[i]]);
 		}
-		// after we've processed all of the meshes (if any) we then recursively process each of the children nodes
+		// after we've collected all of the meshes (if any) we then recursively process each of the children nodes
 		for (unsigned int i = 0; i < node->mNumChildren; i++)
 		{
-			processNode(node->mChildren[i], scene);
+			processNode(node->mChildren[i], scene, order);
 		}
 
 	}
 
-	void SetVertexBoneDataToDefault(Vertex& vertex)
+	// builds the meshes in node order. Materials and bone ids are done first, one mesh after the other, so the
+	// textures and ids come out the same as ever; then every mesh converts its vertices, indices and weights
+	// on the thread pool into its own slot
+	void processMeshes(const aiScene* scene)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		vector<const aiMesh*> order;
+		processNode(scene->mRootNode, scene, order);
+
+		vector<vector<MeshTextureRef>> textures(order.size());
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			textures[i] = processMaterial(order[i], scene);
+			AssignBoneIDs(order[i]);
+		}
+
+		// the textures new to the cache are decoded alongside
+		vector<std::shared_ptr<const MeshData>> meshData(order.size());
+		// partitioned meshes are packed once split
+		bool pack = packVertices && maxBonesPerDraw <= 0;
+		vector<PackedVertices> packed(pack ? order.size() : 0);
+		vector<MeshOptimizeStats> stats(order.size());
+		ThreadPool& pool = GetThreadPool();
+		pool.ParallelFor(static_cast<int>(order.size() + m_PendingTextures.size()), [&](int i)
+		{
+			if (i < static_cast<int>(order.size()))
+			{
+				meshData[i] = processMesh(order[i], std::move(textures[i]), stats[i]);
+				if (pack)
+					packed[i] = PackVertices(meshData[i]->GetVertices(), meshData[i]->GetNumVertices());
+			}
+			else
+				DecodeTexture(m_PendingTextures[i - order.size()]);
+		});
+		m_MeshData.insert(m_MeshData.end(), meshData.begin(), meshData.end());
+		m_PackedVertices.insert(m_PackedVertices.end(), std::make_move_iterator(packed.begin()), std::make_move_iterator(packed.end()));
+
+		for (size_t i = 0; i < stats.size(); i++)
+		{
+			const MeshOptimizeStats& mesh = stats[i];
+			std::cout << "Mesh " << m_MeshData.size() - order.size() + i << ": " << mesh.verticesIn << " -> " << mesh.verticesOut << " vertices, "
+				<< mesh.triangles << " triangles, ACMR " << mesh.before.acmr << " -> " << mesh.after.acmr << ", ATVR " << mesh.before.atvr
+				<< " -> " << mesh.after.atvr << (mesh.verticesOut <= 65536 ? ", 16 bit indices" : ", 32 bit indices") << std::endl;
+		}
+
+		auto end = std::chrono::high_resolution_clock::now();
+		std::cout << "Processed " << order.size() << " meshes on up to " << pool.GetNumThreads() + 1 << " threads: "
+			<< std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+	}
+
+	static void SetVertexBoneDataToDefault(Vertex& vertex)
 	{
 		for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
 		{
@@ -106,11 +588,15 @@ private:
 	}
 
 
-	Mesh processMesh(aiMesh* mesh, const aiScene* scene)
+	// CPU work of one mesh, only reads the model so meshes can run concurrently
+	std::shared_ptr<const MeshData> processMesh(const aiMesh* mesh, vector<MeshTextureRef> textures, MeshOptimizeStats& stats)
 	{
-		vector<Vertex> vertices;
-		vector<unsigned int> indices;
-		vector<Texture> textures;
+		auto data = std::make_shared<MeshData>();
+		vector<Vertex>& vertices = data->vertices;
+		vector<unsigned int>& indices = data->indices;
+		data->textures = std::move(textures);
+		vertices.reserve(mesh->mNumVertices);
+		indices.reserve(mesh->mNumFaces * 3);
 
 		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
 		{
@@ -131,6 +617,17 @@ private:
 			else
 				vertex.TexCoords = glm::vec2(0.0f, 0.0f);
 
+			if (mesh->mTangents)
+			{
+				vertex.Tangent = AssimpGLMHelpers::GetGLMVec(mesh->mTangents[i]);
+				vertex.Bitangent = AssimpGLMHelpers::GetGLMVec(mesh->mBitangents[i]);
+			}
+			else
+			{
+				vertex.Tangent = glm::vec3(0.0f);
+				vertex.Bitangent = glm::vec3(0.0f);
+			}
+
 			vertices.push_back(vertex);
 		}
 		for (unsigned int i = 0; i < mesh->mNumFaces; i++)
@@ -139,79 +636,88 @@ private:
 			for (unsigned int j = 0; j < face.mNumIndices; j++)
 				indices.push_back(face.mIndices[j]);
 		}
+		ExtractBoneWeightForVertices(vertices, mesh);
+
+		// Assimp gives every face its own vertices (the import doesn't join them), welding and reordering is done here
+		stats = MeshOptimizer::OptimizeMesh(vertices, indices);
+		return data;
+	}
+
+	// the textures of the mesh's material, decoded once per path
+	vector<MeshTextureRef> processMaterial(const aiMesh* mesh, const aiScene* scene)
+	{
+		vector<MeshTextureRef> textures;
 		aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
 		std::cout << "Texture number: " << scene->mNumTextures << std::endl;
 		LoadTexture(scene);
-		vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+		vector<MeshTextureRef> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
 		textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-		vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+		vector<MeshTextureRef> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
 		textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-		std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
+		std::vector<MeshTextureRef> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
 		textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
-		std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
+		std::vector<MeshTextureRef> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
 		textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
-
-		ExtractBoneWeightForVertices(vertices, mesh, scene);
-
-		return Mesh(vertices, indices, textures);
+		return textures;
 	}
 
 	void LoadTexture(const aiScene* scene)
 	{
 		for (unsigned int i = 0; i < scene->mNumTextures; i++) 
 		{	
-			bool skip = false;
 			aiTexture* texture = scene->mTextures[i];
-			aiString path = texture->mFilename;
-			for (unsigned int j = 0; j < textures_loaded.size(); j++)
-			{
-				if (std::strcmp(textures_loaded[j].path.data(), path.C_Str()) == 0)
+			LoadEmbeddedTexture(texture->mFilename.C_Str(), reinterpret_cast<const unsigned char*>(texture->pcData),
+				GetEmbeddedTextureSize(texture), GetEmbeddedTextureType(scene, texture->mFilename.C_Str()));
+		}
+	}
+
+	// bytes of an embedded texture: the compressed file when mHeight is 0, otherwise mWidth * mHeight texels.
+	// The texture cache, Cook() and CookTextures() all hash this many bytes, so they find the same entries
+	static uint32_t GetEmbeddedTextureSize(const aiTexture* texture)
+	{
+		return texture->mHeight == 0 ? texture->mWidth : static_cast<uint32_t>(texture->mWidth * texture->mHeight * sizeof(aiTexel));
+	}
+
+	// the type processMaterial() names the first material slot using the embedded texture at path, "" if none does
+	static string GetEmbeddedTextureType(const aiScene* scene, const char* path)
+	{
+		const std::pair<aiTextureType, const char*> types[] = { { aiTextureType_DIFFUSE, "texture_diffuse" },
+			{ aiTextureType_SPECULAR, "texture_specular" }, { aiTextureType_HEIGHT, "texture_normal" }, { aiTextureType_AMBIENT, "texture_height" } };
+		const aiTexture* texture = scene->GetEmbeddedTexture(path);
+		for (unsigned int m = 0; m < scene->mNumMaterials; m++)
+			for (const auto& type : types)
+				for (unsigned int i = 0; i < scene->mMaterials[m]->GetTextureCount(type.first); i++)
 				{
-					skip = true;
-					break;
-				}
-			}
-			if (!skip) {
-				unsigned int textureID;
-				glGenTextures(1, &textureID);
-				unsigned char* data = nullptr;
-				int width, height, nrComponents;
-				if (texture->mHeight == 0) {
-					data = stbi_load_from_memory(reinterpret_cast<unsigned char*>(texture->pcData), texture->mWidth, &width, &height, &nrComponents, 0);
-				}
-				else {
-					data = stbi_load_from_memory(reinterpret_cast<unsigned char*>(texture->pcData), texture->mWidth * texture->mHeight, &width, &height, &nrComponents, 0);
+					aiString slot;
+					scene->mMaterials[m]->GetTexture(type.first, i, &slot);
+					if (scene->GetEmbeddedTexture(slot.C_Str()) == texture)
+						return type.second;
 				}
-				if (data) {
-					glBindTexture(GL_TEXTURE_2D, textureID);
-					GLenum format;
-					if (nrComponents == 1)
-						format = GL_RED;
-					else if (nrComponents == 3)
-						format = GL_RGB;
-					else if (nrComponents == 4)
-						format = GL_RGBA;
-					glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-					glGenerateMipmap(GL_TEXTURE_2D);
-
-					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-					stbi_image_free(data);
-					Texture mytexture;
-					mytexture.id = textureID;
-					mytexture.type = ""; // TODO: add t
-					mytexture.path = path.C_Str();
-					std::cout<<" Texture Path Load: "<<mytexture.path<<std::endl;
-					textures_loaded.push_back(mytexture);
-				}
-				
-			}
-		}
+		return "";
+	}
+
+	// looks up a texture stored inside the model file, once per path
+	void LoadEmbeddedTexture(const char* path, const unsigned char* fileData, uint32_t size, const string& type)
+	{
+		if (m_PendingIndex.find(path) != m_PendingIndex.end())
+			return;
+		PendingTexture texture;
+		texture.texture = GetTextureCache().Find(path, fileData, size, directory);
+		texture.type = type;
+		texture.path = path;
+		std::cout<<" Texture Path Load: "<<texture.path<<std::endl;
+		m_PendingIndex[texture.path] = static_cast<int>(m_PendingTextures.size());
+		m_PendingTextures.push_back(texture);
+	}
+
+	// decodes on the calling thread unless the cache already has, or another model is doing it
+	static void DecodeTexture(const PendingTexture& texture)
+	{
+		if (texture.texture)
+			GetTextureCache().Decode(*texture.texture);
 	}
 
-	void SetVertexBoneData(Vertex& vertex, int boneID, float weight)
+	static void SetVertexBoneData(Vertex& vertex, int boneID, float weight)
 	{
 		for (int i = 0; i < MAX_BONE_INFLUENCE; ++i)
 		{
@@ -225,14 +731,14 @@ private:
 	}
 
 
-	void ExtractBoneWeightForVertices(std::vector<Vertex>& vertices, aiMesh* mesh, const aiScene* scene)
+	// hands out ids to the bones of mesh not seen before, in the order meshes and their bones come
+	void AssignBoneIDs(const aiMesh* mesh)
 	{
 		auto& boneInfoMap = m_BoneInfoMap;
 		int& boneCount = m_BoneCounter;
-		
+
 		for (int boneIndex = 0; boneIndex < mesh->mNumBones; ++boneIndex)
 		{
-			int boneID = -1;
 			std::string boneName = mesh->mBones[boneIndex]->mName.C_Str();
 			if (boneInfoMap.find(boneName) == boneInfoMap.end())
 			{
@@ -240,17 +746,22 @@ private:
 				newBoneInfo.id = boneCount;
 				newBoneInfo.offset = AssimpGLMHelpers::ConvertMatrixToGLMFormat(mesh->mBones[boneIndex]->mOffsetMatrix);
 				boneInfoMap[boneName] = newBoneInfo;
-				boneID = boneCount;
 				boneCount++;
 			}
-			else
-			{
-				boneID = boneInfoMap[boneName].id;
-			}
-			assert(boneID != -1);
+			std::cout<<"Bone Name: "<<boneName<<" Bone ID: "<<boneInfoMap[boneName].id<<" Num Weights: "<<mesh->mBones[boneIndex]->mNumWeights<<std::endl;
+		}
+	}
+
+	// bone ids come from AssignBoneIDs(), the map is only read here
+	void ExtractBoneWeightForVertices(std::vector<Vertex>& vertices, const aiMesh* mesh) const
+	{
+		for (unsigned int boneIndex = 0; boneIndex < mesh->mNumBones; ++boneIndex)
+		{
+			auto bone = m_BoneInfoMap.find(mesh->mBones[boneIndex]->mName.C_Str());
+			assert(bone != m_BoneInfoMap.end());
+			int boneID = bone->second.id;
 			auto weights = mesh->mBones[boneIndex]->mWeights;
 			int numWeights = mesh->mBones[boneIndex]->mNumWeights;
-			std::cout<<"Bone Name: "<<boneName<<" Bone ID: "<<boneID<<" Num Weights: "<<numWeights<<std::endl;
 
 			for (int weightIndex = 0; weightIndex < numWeights; ++weightIndex)
 			{
@@ -263,82 +774,64 @@ private:
 	}
 
 
-	unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false)
+	PendingTexture TextureFromFile(const char* path, const string& directory, bool gamma = false)
 	{
 		string filename = string(path);
 		filename = directory + '/' + filename;
 
-		unsigned int textureID;
-		glGenTextures(1, &textureID);
-
-		int width, height, nrComponents;
-		unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-		if (data)
-		{
-			GLenum format;
-			if (nrComponents == 1)
-				format = GL_RED;
-			else if (nrComponents == 3)
-				format = GL_RGB;
-			else if (nrComponents == 4)
-				format = GL_RGBA;
-
-			glBindTexture(GL_TEXTURE_2D, textureID);
-			glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-			glGenerateMipmap(GL_TEXTURE_2D);
-
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-			stbi_image_free(data);
-		}
-		else
-		{
+		PendingTexture texture;
+		texture.texture = GetTextureCache().Find(filename);
+		if (!texture.texture)
 			std::cout << "Texture failed to load at path: " << path << std::endl;
-			stbi_image_free(data);
-		}
+		return texture;
+	}
 
+	// the cache's GL texture, an empty texture name if the file couldn't be read
+	static unsigned int UploadTexture(const PendingTexture& texture)
+	{
+		if (texture.texture)
+			return GetTextureCache().Upload(*texture.texture);
+		unsigned int textureID;
+		glGenTextures(1, &textureID);
 		return textureID;
 	}
 
 	// checks all material textures of a given type and loads the textures if they're not loaded yet.
-	// the required info is returned as a Texture struct.
-	vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
+	// the required info is returned as a MeshTextureRef.
+	vector<MeshTextureRef> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
 	{
-		vector<Texture> textures;
+		vector<MeshTextureRef> textures;
 		
 		for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
 		{
 			aiString str;
 			mat->GetTexture(type, i, &str);
 			std::cout <<"Textrue Path: "<< str.C_Str() << std::endl;
-			// check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-			bool skip = false;
-			for (unsigned int j = 0; j < textures_loaded.size(); j++)
-			{
-				if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-				{
-					textures.push_back(textures_loaded[j]);
-					textures_loaded[j].type = typeName;  // redefine the texture type.
-					skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-					break;
-				}
-			}
-			if (!skip)
-			{   // if texture hasn't been loaded already, load it
-				Texture texture;
-				texture.id = TextureFromFile(str.C_Str(), this->directory);
-				texture.type = typeName;
-				texture.path = str.C_Str();
-				textures.push_back(texture);
-				textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
-			}
+			textures.push_back(LoadMaterialTexture(str.C_Str(), typeName));
 		}
 		return textures;
 	}
 
+	MeshTextureRef LoadMaterialTexture(const char* path, const string& typeName)
+	{
+		// check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
+		auto loaded = m_PendingIndex.find(path);
+		if (loaded != m_PendingIndex.end())
+		{
+			int j = loaded->second;
+			MeshTextureRef texture = { j, typeName, m_PendingTextures[j].path };
+			m_PendingTextures[j].type = typeName;  // redefine the texture type.
+			return texture; // a texture with the same filepath has already been loaded (optimization)
+		}
+		// if texture hasn't been loaded already, load it
+		PendingTexture texture = TextureFromFile(path, this->directory);
+		texture.type = typeName;
+		texture.path = path;
+		m_PendingIndex[texture.path] = static_cast<int>(m_PendingTextures.size());
+		m_PendingTextures.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
+		return { static_cast<int>(m_PendingTextures.size()) - 1, typeName, path };
+	}
+
 };
 
 
@@ -0,0 +1,223 @@
+#pragma once
+
+/* On-disk cache of linked program binaries (GL_ARB_get_program_binary, core since 4.1).
+   glad only loads 3.3 core here, so the three entry points are fetched through GLFW once a context is current.
+   Binaries are kept in ProgramBinaryDirectory, out of the source tree, and keyed by the program's sources, its
+   defines and the driver that produced them; one that doesn't match, or that the driver refuses, is deleted and the program is built from source. */
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <learnopengl/mapped_file.h>
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+const uint32_t ProgramBinaryMagic = 0x4E424C47;	// "GLBN"
+const uint32_t ProgramBinaryVersion = 1;
+const char* const ProgramBinaryExtension = ".glbin";
+// relative to the working directory, created on the first Store()
+const char* const ProgramBinaryDirectory = "cache";
+
+struct ProgramBinaryHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;		// sources, defines, vendor, renderer and driver version
+	uint32_t format;	// the driver's binary format
+	uint32_t length;
+};
+
+struct ProgramCacheStats
+{
+	int hits = 0;
+	int misses = 0;		// no binary, or a stale one
+	int rejected = 0;	// matched, but the driver wouldn't take it back
+	int stored = 0;
+};
+
+class ProgramBinaryCache
+{
+public:
+	// false without a current context or when the driver has no binary formats; programs are then always compiled
+	bool IsSupported()
+	{
+		if (!m_SupportQueried)
+		{
+			m_SupportQueried = true;
+			bool extension = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 1);
+			GLint count = 0;
+			glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+			for (GLint i = 0; i < count && !extension; i++)
+				extension = std::strcmp(reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i)), "GL_ARB_get_program_binary") == 0;
+			GLint formats = 0;
+			if (extension)
+				glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+			m_GetProgramBinary = reinterpret_cast<GetProgramBinaryProc>(glfwGetProcAddress("glGetProgramBinary"));
+			m_ProgramBinary = reinterpret_cast<ProgramBinaryProc>(glfwGetProcAddress("glProgramBinary"));
+			m_ProgramParameteri = reinterpret_cast<ProgramParameteriProc>(glfwGetProcAddress("glProgramParameteri"));
+			m_Supported = formats > 0 && m_GetProgramBinary && m_ProgramBinary && m_ProgramParameteri;
+
+			// a driver update changes these strings and with them every key
+			for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+			{
+				const GLubyte* value = glGetString(name);
+				if (value)
+					m_Driver += reinterpret_cast<const char*>(value);
+				m_Driver += '\n';
+			}
+		}
+		return m_Supported;
+	}
+
+	// where the binary of the program built from these stages with these defines is kept
+	std::string GetPath(const std::vector<std::string>& stagePaths, const std::string& defines) const
+	{
+		uint64_t hash = Hash(defines);
+		for (const std::string& path : stagePaths)
+			hash = Hash(path, hash);
+		char name[24];
+		std::snprintf(name, sizeof(name), ".%08x", static_cast<unsigned int>(hash ^ (hash >> 32)));
+		const std::string& vertexPath = stagePaths.front();
+		return std::string(ProgramBinaryDirectory) + "/" + vertexPath.substr(vertexPath.find_last_of("/\\") + 1) + name
+			+ ProgramBinaryExtension;
+	}
+
+	// identifies the binary of these sources and defines from this driver
+	uint64_t GetKey(const std::vector<std::string>& sources, const std::string& defines)
+	{
+		IsSupported();
+		uint64_t key = Hash(m_Driver);
+		key = Hash(defines, key);
+		for (const std::string& source : sources)
+			key = Hash(source, key);
+		return key;
+	}
+
+	// call before linking a program that will be stored
+	void PrepareLink(GLuint program)
+	{
+		if (IsSupported())
+			m_ProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+
+	// links program from the binary at path if it was built for key, deleting the file when it wasn't or the driver refuses it
+	bool Load(GLuint program, const std::string& path, uint64_t key)
+	{
+		if (!IsSupported())
+			return false;
+		std::ifstream file(path, std::ios::binary);
+		ProgramBinaryHeader header = {};
+		std::vector<char> binary;
+		if (file.read(reinterpret_cast<char*>(&header), sizeof(header)) && header.magic == ProgramBinaryMagic
+			&& header.version == ProgramBinaryVersion && header.key == key)
+		{
+			binary.resize(header.length);
+			if (!file.read(binary.data(), binary.size()))
+				binary.clear();
+		}
+		bool present = file.is_open();
+		file.close();
+		if (binary.empty())
+		{
+			m_Stats.misses++;
+			if (present)
+				std::remove(path.c_str());
+			return false;
+		}
+
+		m_ProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+		GLint success = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			m_Stats.rejected++;
+			std::remove(path.c_str());
+			return false;
+		}
+		m_Stats.hits++;
+		return true;
+	}
+
+	// writes the binary of the linked program to path under key
+	bool Store(GLuint program, const std::string& path, uint64_t key)
+	{
+		if (!IsSupported())
+			return false;
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0)
+			return false;
+		std::vector<char> binary(length);
+		ProgramBinaryHeader header = {};
+		header.magic = ProgramBinaryMagic;
+		header.version = ProgramBinaryVersion;
+		header.key = key;
+		GLsizei written = 0;
+		GLenum format = 0;
+		m_GetProgramBinary(program, length, &written, &format, binary.data());
+		header.format = format;
+		header.length = static_cast<uint32_t>(written);
+
+		if (!MakeDirectory(ProgramBinaryDirectory))
+		{
+			std::cout << "ERROR::PROGRAM_CACHE:: could not create " << ProgramBinaryDirectory << std::endl;
+			return false;
+		}
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(binary.data(), written);
+		if (!file.good())
+		{
+			std::cout << "ERROR::PROGRAM_CACHE:: could not write " << path << std::endl;
+			return false;
+		}
+		m_Stats.stored++;
+		return true;
+	}
+
+	ProgramCacheStats GetStats() const { return m_Stats; }
+
+private:
+	typedef void (APIENTRYP GetProgramBinaryProc)(GLuint, GLsizei, GLsizei*, GLenum*, void*);
+	typedef void (APIENTRYP ProgramBinaryProc)(GLuint, GLenum, const void*, GLsizei);
+	typedef void (APIENTRYP ProgramParameteriProc)(GLuint, GLenum, GLint);
+
+	// FNV-1a
+	static uint64_t Hash(const std::string& text, uint64_t hash = 14695981039346656037ull)
+	{
+		for (unsigned char c : text)
+			hash = (hash ^ c) * 1099511628211ull;
+		return hash;
+	}
+
+	bool m_SupportQueried = false;
+	bool m_Supported = false;
+	std::string m_Driver;
+	GetProgramBinaryProc m_GetProgramBinary = nullptr;
+	ProgramBinaryProc m_ProgramBinary = nullptr;
+	ProgramParameteriProc m_ProgramParameteri = nullptr;
+	ProgramCacheStats m_Stats;
+};
+
+// the cache every Shader goes through
+inline ProgramBinaryCache& GetProgramBinaryCache()
+{
+	static ProgramBinaryCache cache;
+	return cache;
+}
@@ -3,11 +3,16 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <learnopengl/program_cache.h>
 
+#include <algorithm>
+#include <chrono>
 #include <string>
+#include <unordered_map>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
 
 class Shader
 {
@@ -15,8 +20,10 @@ public:
     unsigned int ID;
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath)
+    // defines are "#define KEY value" lines inserted after every stage's #version, see ShaderVariants
+    Shader(const char* vertexPath, const char* fragmentPath, const std::string& defines = "")
     {
+        auto start = std::chrono::high_resolution_clock::now();
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
         std::string fragmentCode;
@@ -45,9 +52,22 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
         }
+        vertexCode = injectDefines(vertexCode, defines);
+        fragmentCode = injectDefines(fragmentCode, defines);
         const char* vShaderCode = vertexCode.c_str();
         const char* fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
+        // 2. take the linked program from the binary cache when this driver built it from these sources before
+        ProgramBinaryCache& cache = GetProgramBinaryCache();
+        std::string cachePath = cache.GetPath({ vertexPath, fragmentPath }, defines);
+        uint64_t cacheKey = cache.GetKey({ vertexCode, fragmentCode }, defines);
+        ID = glCreateProgram();
+        if (cache.Load(ID, cachePath, cacheKey))
+        {
+            reflectUniforms();
+            reportBuildTime(vertexPath, "loaded from the binary cache", start);
+            return;
+        }
+        // 3. compile shaders
         unsigned int vertex, fragment;
         // vertex shader
         vertex = glCreateShader(GL_VERTEX_SHADER);
@@ -60,14 +80,17 @@ public:
         glCompileShader(fragment);
         checkCompileErrors(fragment, "FRAGMENT");
         // shader Program
-        ID = glCreateProgram();
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
+        cache.PrepareLink(ID);
         glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+        if (checkCompileErrors(ID, "PROGRAM"))
+            cache.Store(ID, cachePath, cacheKey);
+        reflectUniforms();
         // delete the shaders as they're linked into our program now and no longer necessary
         glDeleteShader(vertex);
         glDeleteShader(fragment);
+        reportBuildTime(vertexPath, "compiled", start);
 
     }
     // activate the shader
@@ -76,69 +99,150 @@ public:
     {
         glUseProgram(ID);
     }
+    // location of an active uniform, -1 if the program doesn't use it. Names reflected at link time are a table
+    // lookup; anything else (a single array element, an unused name) is asked of GL once and remembered
+    // ------------------------------------------------------------------------
+    GLint getUniformLocation(const std::string& name) const
+    {
+        auto it = uniformLocations.find(name);
+        if (it != uniformLocations.end())
+            return it->second;
+        GLint location = glGetUniformLocation(ID, name.c_str());
+        uniformLocations.emplace(name, location);
+        return location;
+    }
+    // attaches the uniform block name to binding, false if the program has no such block
+    // ------------------------------------------------------------------------
+    bool bindUniformBlock(const std::string& name, GLuint binding) const
+    {
+        GLuint index = glGetUniformBlockIndex(ID, name.c_str());
+        if (index == GL_INVALID_INDEX)
+            return false;
+        glUniformBlockBinding(ID, index, binding);
+        return true;
+    }
     // utility uniform functions
     // ------------------------------------------------------------------------
     void setBool(const std::string& name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        glUniform1i(getUniformLocation(name), (int)value);
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string& name, int value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1i(getUniformLocation(name), value);
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string& name, float value) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1f(getUniformLocation(name), value);
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string& name, const glm::vec2& value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform2fv(getUniformLocation(name), 1, &value[0]);
     }
     void setVec2(const std::string& name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        glUniform2f(getUniformLocation(name), x, y);
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string& name, const glm::vec3& value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform3fv(getUniformLocation(name), 1, &value[0]);
     }
     void setVec3(const std::string& name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        glUniform3f(getUniformLocation(name), x, y, z);
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string& name, const glm::vec4& value) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform4fv(getUniformLocation(name), 1, &value[0]);
     }
     void setVec4(const std::string& name, float x, float y, float z, float w) const
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        glUniform4f(getUniformLocation(name), x, y, z, w);
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string& name, const glm::mat2& mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string& name, const glm::mat3& mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string& name, const glm::mat4& mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
+    }
+    // uploads count matrices to the array name starting at its first element, in one call
+    // ------------------------------------------------------------------------
+    void setMat4Array(const std::string& name, const glm::mat4* mats, int count) const
+    {
+        if (count > 0)
+            glUniformMatrix4fv(getUniformLocation(name), count, GL_FALSE, &mats[0][0][0]);
+    }
+    void setMat4Array(const std::string& name, const std::vector<glm::mat4>& mats) const
+    {
+        setMat4Array(name, mats.data(), static_cast<int>(mats.size()));
     }
 
 private:
+    // active uniforms by name, filled after linking. Arrays are also listed under their bare name
+    mutable std::unordered_map<std::string, GLint> uniformLocations;
+
+    // reads the program's active uniforms into uniformLocations
+    // ------------------------------------------------------------------------
+    void reflectUniforms()
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> buffer(maxLength > 0 ? maxLength : 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, i, static_cast<GLsizei>(buffer.size()), &length, &size, &type, buffer.data());
+            std::string name(buffer.data(), length);
+            GLint location = glGetUniformLocation(ID, name.c_str());
+            if (location < 0)
+                continue;   // a member of a uniform block
+            uniformLocations[name] = location;
+            // arrays report "name[0]", setters use "name" for the whole array
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+                uniformLocations[name.substr(0, name.size() - 3)] = location;
+        }
+    }
+    // inserts defines after the #version line, with a #line so compile errors keep the file's line numbers
+    // ------------------------------------------------------------------------
+    static std::string injectDefines(const std::string& code, const std::string& defines)
+    {
+        if (defines.empty())
+            return code;
+        size_t version = code.find("#version");
+        size_t end = version == std::string::npos ? std::string::npos : code.find('\n', version);
+        if (end == std::string::npos)
+            return defines + code;
+        int nextLine = 2 + static_cast<int>(std::count(code.begin(), code.begin() + end, '\n'));
+        return code.substr(0, end + 1) + defines + "#line " + std::to_string(nextLine) + "\n" + code.substr(end + 1);
+    }
+    // prints how long the program took to build, from source or from its cached binary
+    // ------------------------------------------------------------------------
+    void reportBuildTime(const char* vertexPath, const char* how, std::chrono::high_resolution_clock::time_point start) const
+    {
+        auto end = std::chrono::high_resolution_clock::now();
+        std::cout << "Program " << vertexPath << " " << how << " in " << std::chrono::duration<double, std::milli>(end - start).count()
+            << " ms" << std::endl;
+    }
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type)
+    bool checkCompileErrors(GLuint shader, std::string type)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -160,6 +264,7 @@ private:
                 std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success != 0;
     }
 };
 #endif
@@ -0,0 +1,111 @@
+#pragma once
+
+/* Specialized programs built from one pair of shader sources. Each feature a draw needs becomes a #define, so a
+   mesh weighted to two bones runs a vertex shader that blends two matrices and no other, and a static mesh one
+   that doesn't skin at all. Variants are compiled the first time they are asked for and kept. */
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <learnopengl/shader.h>
+
+// the keys a pair of sources understands; keys it doesn't stay at their defaults so they don't multiply variants
+enum ShaderKey
+{
+	ShaderKeySkinning = 1 << 0,		// SKINNING 0/1
+	ShaderKeyInfluences = 1 << 1,	// BONE_INFLUENCES 1, 2 or 4
+	ShaderKeyNormalMap = 1 << 2,	// NORMAL_MAP 0/1
+	ShaderKeyPalette = 1 << 3,		// MAX_BONES
+	ShaderKeyPackedVertex = 1 << 4,	// PACKED_VERTEX 0/1, the mesh's VertexFormat
+	ShaderKeyInstanced = 1 << 5,	// INSTANCED 0/1, model and palette per instance from a texture buffer, see SkinnedCrowd
+	ShaderKeyBaked = 1 << 6,		// BAKED 0/1, instanced palettes from a BakedAnimation
+	ShaderKeyDualQuaternion = 1 << 7,	// DUAL_QUATERNION 0/1, Character block palette of dual quaternions
+	ShaderKeyLocalPalette = 1 << 8,	// LOCAL_PALETTE 0/1, a partitioned mesh's bones in a uniform array, see MeshPartition
+	ShaderKeyAll = 0x1FF,
+};
+
+struct ShaderFeatures
+{
+	bool skinning = true;
+	int influences = 4;
+	bool normalMap = false;
+	int paletteSize = 100;
+	bool packedVertex = false;
+	bool instanced = false;
+	bool baked = false;
+	bool dualQuaternion = false;
+	bool localPalette = false;
+
+	// the #define lines of these features, keys outside mask left out
+	std::string GetDefines(unsigned int mask) const
+	{
+		std::string defines;
+		if (mask & ShaderKeySkinning)
+			defines += std::string("#define SKINNING ") + (skinning ? "1" : "0") + "\n";
+		if ((mask & ShaderKeyInfluences) && skinning)
+			defines += "#define BONE_INFLUENCES " + std::to_string(influences) + "\n";
+		if (mask & ShaderKeyNormalMap)
+			defines += std::string("#define NORMAL_MAP ") + (normalMap ? "1" : "0") + "\n";
+		if ((mask & ShaderKeyPalette) && skinning)
+			defines += "#define MAX_BONES " + std::to_string(paletteSize) + "\n";
+		if (mask & ShaderKeyPackedVertex)
+			defines += std::string("#define PACKED_VERTEX ") + (packedVertex ? "1" : "0") + "\n";
+		if (mask & ShaderKeyInstanced)
+			defines += std::string("#define INSTANCED ") + (instanced ? "1" : "0") + "\n";
+		if (mask & ShaderKeyBaked)
+			defines += std::string("#define BAKED ") + (baked && instanced ? "1" : "0") + "\n";
+		if ((mask & ShaderKeyDualQuaternion) && skinning)
+			defines += std::string("#define DUAL_QUATERNION ") + (dualQuaternion && !instanced ? "1" : "0") + "\n";
+		if ((mask & ShaderKeyLocalPalette) && skinning)
+			defines += std::string("#define LOCAL_PALETTE ") + (localPalette && !instanced && !dualQuaternion ? "1" : "0") + "\n";
+		return defines;
+	}
+};
+
+// rounds a per-vertex influence count up to the variants built for, 0 for a mesh without bones
+inline int GetInfluenceVariant(int influences)
+{
+	if (influences <= 0)
+		return 0;
+	return influences == 1 ? 1 : influences == 2 ? 2 : 4;
+}
+
+class ShaderVariants
+{
+public:
+	ShaderVariants(const std::string& vertexPath, const std::string& fragmentPath, unsigned int keys = ShaderKeyAll)
+		:
+		m_VertexPath(vertexPath),
+		m_FragmentPath(fragmentPath),
+		m_Keys(keys)
+	{
+	}
+
+	// called on every variant once it is built, e.g. to bind its uniform blocks
+	void SetOnBuild(std::function<void(Shader&)> onBuild) { m_OnBuild = std::move(onBuild); }
+
+	// the program specialized for features, built on first use. Needs the GL context
+	Shader& Get(const ShaderFeatures& features)
+	{
+		std::string defines = features.GetDefines(m_Keys);
+		auto it = m_Variants.find(defines);
+		if (it != m_Variants.end())
+			return *it->second;
+
+		std::unique_ptr<Shader> shader(new Shader(m_VertexPath.c_str(), m_FragmentPath.c_str(), defines));
+		if (m_OnBuild)
+			m_OnBuild(*shader);
+		return *m_Variants.emplace(defines, std::move(shader)).first->second;
+	}
+
+	int GetNumVariants() const { return static_cast<int>(m_Variants.size()); }
+
+private:
+	std::string m_VertexPath;
+	std::string m_FragmentPath;
+	unsigned int m_Keys;
+	std::function<void(Shader&)> m_OnBuild;
+	std::map<std::string, std::unique_ptr<Shader>> m_Variants;
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+/* Flattened bone hierarchy.
+   Joints are stored in topological order (every parent before its children) as parallel arrays,
+   so local-to-model transforms are one linear loop over the joints.
+   A Model builds the skeleton of its rig once and shares it read-only with every clip and animator bound to it. */
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <learnopengl/transform.h>
+
+class Skeleton
+{
+public:
+	// parent has to be added before the joint, -1 for a root; boneID is the joint's palette index or -1
+	int AddJoint(const std::string& name, int parent, const Transform& bindPose, int boneID, const glm::mat4x3& offset)
+	{
+		m_Names.push_back(name);
+		m_Parents.push_back(parent);
+		m_BindPoses.push_back(bindPose);
+		m_BoneIDs.push_back(boneID);
+		m_Offsets.push_back(offset);
+		m_PaletteSize = std::max(m_PaletteSize, boneID + 1);
+		return static_cast<int>(m_Parents.size()) - 1;
+	}
+
+	int FindJoint(const std::string& name) const
+	{
+		for (int i = 0; i < static_cast<int>(m_Names.size()); i++)
+			if (m_Names[i] == name)
+				return i;
+		return -1;
+	}
+
+	// model space transform of every joint from its local pose, both indexed by joint
+	void CalculateModelTransforms(const std::vector<Transform>& localPoses, std::vector<glm::mat4x3>& modelTransforms) const
+	{
+		int numJoints = GetNumJoints();
+		modelTransforms.resize(numJoints);
+		for (int i = 0; i < numJoints; i++)
+		{
+			glm::mat4x3 local = ComposeAffine(localPoses[i]);
+			int parent = m_Parents[i];
+			modelTransforms[i] = parent < 0 ? local : MulAffine(modelTransforms[parent], local);
+		}
+	}
+
+	inline int GetNumJoints() const { return static_cast<int>(m_Parents.size()); }
+	inline int GetPaletteSize() const { return m_PaletteSize; }
+	inline const std::vector<std::string>& GetNames() const { return m_Names; }
+	inline const std::vector<int>& GetParents() const { return m_Parents; }
+	inline const std::vector<Transform>& GetBindPoses() const { return m_BindPoses; }
+	inline const std::vector<int>& GetBoneIDs() const { return m_BoneIDs; }
+	inline const std::vector<glm::mat4x3>& GetOffsets() const { return m_Offsets; }
+
+private:
+	std::vector<std::string> m_Names;	// only used while binding, never per frame
+	std::vector<int> m_Parents;
+	std::vector<Transform> m_BindPoses;
+	std::vector<int> m_BoneIDs;
+	std::vector<glm::mat4x3> m_Offsets;
+	int m_PaletteSize = 0;
+};
@@ -0,0 +1,174 @@
+#pragma once
+
+/* Many characters sharing one Model drawn with one instanced call per mesh. Every instance's model matrix and bone
+   palette are packed into one texture buffer as 3x4 rows (the last row of an affine matrix is implied), and each
+   instance gets the index of its model matrix as a per-instance attribute; the INSTANCED variant of anim_model.vs
+   reads its bones from the entries right after it. Instances added with AddBaked() store only their model matrix
+   and play a clip of a BakedAnimation instead. */
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/baked_animation.h>
+#include <learnopengl/model_animation.h>
+#include <learnopengl/shader_variants.h>
+#include <learnopengl/uniform_buffer.h>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+// texture unit the palette buffer is bound to, above the units meshes use for their textures
+const GLuint PaletteTextureUnit = 15;
+
+class SkinnedCrowd
+{
+public:
+	// room for maxInstances characters of up to bonesPerInstance bones each, Model::GetBoneCount() for a crowd of one
+	// model. Only the texture buffer size limits it, a rig's bones all fit unlike in the Character block
+	SkinnedCrowd(int maxInstances, int bonesPerInstance)
+		:
+		m_MaxInstances(maxInstances),
+		m_BonesPerInstance(bonesPerInstance)
+	{
+		GLint maxTexels = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+		GLint texels = maxInstances * GetStride() * 3;
+		if (texels > maxTexels)
+		{
+			std::cout << "ERROR::SKINNED_CROWD:: " << maxInstances << " instances need " << texels << " texels, the texture buffer holds "
+				<< maxTexels << std::endl;
+			m_MaxInstances = maxTexels / (GetStride() * 3);
+		}
+		m_Palette.reserve(static_cast<size_t>(m_MaxInstances) * GetStride() * 3);
+		m_Instances.reserve(m_MaxInstances);
+
+		glGenBuffers(1, &m_PaletteBuffer);
+		glBindBuffer(GL_TEXTURE_BUFFER, m_PaletteBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, GetPaletteBytes(m_MaxInstances), nullptr, GL_STREAM_DRAW);
+		glGenTextures(1, &m_PaletteTexture);
+		glBindTexture(GL_TEXTURE_BUFFER, m_PaletteTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_PaletteBuffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+		glGenBuffers(1, &m_InstanceBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, m_InstanceBuffer);
+		glBufferData(GL_ARRAY_BUFFER, m_MaxInstances * sizeof(MeshInstance), nullptr, GL_STREAM_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	~SkinnedCrowd()
+	{
+		glDeleteTextures(1, &m_PaletteTexture);
+		glDeleteBuffers(1, &m_PaletteBuffer);
+		glDeleteBuffers(1, &m_InstanceBuffer);
+	}
+
+	SkinnedCrowd(const SkinnedCrowd&) = delete;
+	SkinnedCrowd& operator=(const SkinnedCrowd&) = delete;
+
+	void Clear()
+	{
+		m_Palette.clear();
+		m_Instances.clear();
+	}
+
+	// queues a character, the first bonesPerInstance matrices of palette; false once the crowd is full
+	bool Add(const glm::mat4& model, const std::vector<glm::mat4>& palette)
+	{
+		if (!AddInstance(model, -1, 0.0f, GetStride()))
+			return false;
+		int count = std::min(static_cast<int>(palette.size()), m_BonesPerInstance);
+		for (int i = 0; i < count; i++)
+			AppendRows(palette[i]);
+		// bones the palette doesn't have are identity, like the Animator's defaults
+		for (int i = count; i < m_BonesPerInstance; i++)
+			AppendRows(glm::mat4(1.0f));
+		return true;
+	}
+
+	// queues a character playing clip of the BakedAnimation the crowd is drawn with, timeOffset seconds ahead of the
+	// others. Don't mix with Add() in one crowd, it is drawn with either variant
+	bool AddBaked(const glm::mat4& model, int clip, float timeOffset)
+	{
+		return AddInstance(model, clip, timeOffset, 1);
+	}
+
+	// writes the queued instances into freshly orphaned buffers, so the GPU may still read last frame's
+	void Upload()
+	{
+		int count = GetNumInstances();
+		glBindBuffer(GL_TEXTURE_BUFFER, m_PaletteBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, GetPaletteBytes(m_MaxInstances), nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, m_Palette.size() * sizeof(glm::vec4), m_Palette.data());
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+		glBindBuffer(GL_ARRAY_BUFFER, m_InstanceBuffer);
+		glBufferData(GL_ARRAY_BUFFER, m_MaxInstances * sizeof(MeshInstance), nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(MeshInstance), m_Instances.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// every uploaded instance of model, each mesh in one call
+	void Draw(Model& model, ShaderVariants& variants, ShaderFeatures features = ShaderFeatures())
+	{
+		features.baked = false;
+		DrawInstances(model, variants, features);
+	}
+
+	// every uploaded instance of model playing its clip of baked at time seconds
+	void DrawBaked(Model& model, ShaderVariants& variants, BakedAnimation& baked, float time, ShaderFeatures features = ShaderFeatures())
+	{
+		baked.Bind(time);
+		features.baked = true;
+		DrawInstances(model, variants, features);
+	}
+
+	int GetNumInstances() const { return static_cast<int>(m_Instances.size()); }
+	int GetMaxInstances() const { return m_MaxInstances; }
+	int GetBonesPerInstance() const { return m_BonesPerInstance; }
+
+private:
+	void DrawInstances(Model& model, ShaderVariants& variants, const ShaderFeatures& features)
+	{
+		glActiveTexture(GL_TEXTURE0 + PaletteTextureUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, m_PaletteTexture);
+		model.DrawInstanced(variants, m_InstanceBuffer, GetNumInstances(), features);
+		glActiveTexture(GL_TEXTURE0 + PaletteTextureUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	bool AddInstance(const glm::mat4& model, int clip, float timeOffset, int entries)
+	{
+		size_t base = m_Palette.size() / 3;
+		if (GetNumInstances() >= m_MaxInstances || base + entries > static_cast<size_t>(m_MaxInstances) * GetStride())
+			return false;
+		m_Instances.push_back({ static_cast<int>(base), clip, timeOffset });
+		AppendRows(model);
+		return true;
+	}
+
+	// palette entries per instance, its model matrix and its bones
+	int GetStride() const { return m_BonesPerInstance + 1; }
+
+	GLsizeiptr GetPaletteBytes(int instances) const
+	{
+		return static_cast<GLsizeiptr>(instances) * GetStride() * 3 * sizeof(glm::vec4);
+	}
+
+	void AppendRows(const glm::mat4& m)
+	{
+		for (int row = 0; row < 3; row++)
+			m_Palette.push_back(glm::vec4(m[0][row], m[1][row], m[2][row], m[3][row]));
+	}
+
+	int m_MaxInstances;
+	int m_BonesPerInstance;
+	std::vector<glm::vec4> m_Palette;
+	std::vector<MeshInstance> m_Instances;
+	GLuint m_PaletteBuffer = 0;
+	GLuint m_PaletteTexture = 0;
+	GLuint m_InstanceBuffer = 0;
+};
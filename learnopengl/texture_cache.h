@@ -0,0 +1,362 @@
+#pragma once
+
+/* Process-wide cache of model textures, so an image used by several models or meshes is decoded and uploaded once.
+   Entries are keyed by a hash of the encoded file contents; a path index remembers which entry an unchanged file
+   maps to so repeated requests skip reading it. Handles are shared_ptrs: an entry lives while any model holds one,
+   Purge() deletes the GL textures of entries nobody holds anymore.
+   Images with an up to date cooked file (see cooked_texture.h) are mapped from there and uploaded block compressed.
+   Find() and Decode() may run on any thread, Upload() and Purge() only where the GL context is current. */
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <learnopengl/cooked_texture.h>
+#include <learnopengl/mapped_file.h>
+#include <learnopengl/texture_compression.h>
+
+// not in the GL 3.3 core loader: EXT_texture_compression_s3tc, EXT_texture_sRGB and ARB_texture_compression_bptc
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM
+#define GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM 0x8E8D
+#endif
+
+class CachedTexture
+{
+public:
+	const std::string& GetPath() const { return m_Path; }
+	bool IsUploaded() const { return m_Uploaded; }
+	unsigned int GetID() const { return m_ID; }
+
+private:
+	friend class TextureCache;
+
+	std::string m_Path;						// the first path it was requested by
+	std::vector<unsigned char> m_Encoded;	// file contents until decoded
+	std::once_flag m_Decode;
+	int m_Width = 0;
+	int m_Height = 0;
+	int m_Components = 0;
+	std::shared_ptr<unsigned char> m_Pixels;	// stbi allocation until uploaded, nullptr if decoding failed
+	std::shared_ptr<CookedTextureFile> m_Cooked;	// mapped until uploaded, instead of the encoded contents
+
+	// GL thread only
+	bool m_Uploaded = false;
+	unsigned int m_ID = 0;
+};
+
+struct TextureCacheStats
+{
+	int hits;		// requests served by an existing entry
+	int misses;		// requests that added an entry
+	int decoded;
+	int uploaded;
+	int purged;
+	int cooked;		// entries mapped from cooked files
+	int entries;
+};
+
+class TextureCache
+{
+public:
+	TextureCache() = default;
+	TextureCache(const TextureCache&) = delete;
+	TextureCache& operator=(const TextureCache&) = delete;
+
+	// the texture of an image file; nullptr if it can't be read
+	std::shared_ptr<CachedTexture> Find(const std::string& path)
+	{
+		FileStamp stamp = GetFileStamp(path);
+		if (!stamp.exists)
+			return nullptr;
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			auto known = m_Paths.find(path);
+			if (known != m_Paths.end() && known->second.first == stamp)
+			{
+				auto entry = m_Entries.find(known->second.second);
+				if (entry != m_Entries.end())
+				{
+					m_Hits++;
+					return entry->second;
+				}
+			}
+		}
+
+		auto cooked = std::make_shared<CookedTextureFile>();
+		if (cooked->Open(path + CookedTextureExtension, stamp.size, stamp.time))
+		{
+			Key key(cooked->GetHeader().contentHash, stamp.size);
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Paths[path] = std::make_pair(stamp, key);
+			return FindOrAdd(key, path, std::vector<unsigned char>(), cooked);
+		}
+
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file)
+			return nullptr;
+		std::vector<unsigned char> encoded(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(reinterpret_cast<char*>(encoded.data()), encoded.size());
+		if (!file)
+			return nullptr;
+
+		Key key(HashTextureContents(encoded.data(), encoded.size()), encoded.size());
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Paths[path] = std::make_pair(stamp, key);
+		return FindOrAdd(key, path, std::move(encoded), nullptr);
+	}
+
+	// the texture of an image held in memory, e.g. embedded in a model file. On a miss it is mapped from its cooked
+	// file in cookedDirectory if there is one, otherwise the bytes are copied
+	std::shared_ptr<CachedTexture> Find(const std::string& path, const unsigned char* data, size_t size, const std::string& cookedDirectory = "")
+	{
+		Key key(HashTextureContents(data, size), size);
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			auto entry = m_Entries.find(key);
+			if (entry != m_Entries.end())
+			{
+				m_Hits++;
+				return entry->second;
+			}
+		}
+
+		auto cooked = std::make_shared<CookedTextureFile>();
+		if (cookedDirectory.empty() || !cooked->Open(GetEmbeddedCookedPath(cookedDirectory, key.first), size, 0, key.first))
+			cooked.reset();
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return FindOrAdd(key, path, cooked ? std::vector<unsigned char>() : std::vector<unsigned char>(data, data + size), cooked);
+	}
+
+	// sample colour textures that were cooked as sRGB through sRGB formats, for a gamma correct framebuffer
+	void SetGammaCorrection(bool enabled) { m_GammaCorrection = enabled; }
+
+	// decodes the image once, later and concurrent calls wait for the first one. Any thread
+	void Decode(CachedTexture& texture)
+	{
+		std::call_once(texture.m_Decode, [&]()
+		{
+			if (texture.m_Encoded.empty())
+				return;
+			unsigned char* data = stbi_load_from_memory(texture.m_Encoded.data(), static_cast<int>(texture.m_Encoded.size()),
+				&texture.m_Width, &texture.m_Height, &texture.m_Components, 0);
+			if (data)
+			{
+				texture.m_Pixels.reset(data, stbi_image_free);
+				m_Decoded++;
+			}
+			else
+				std::cout << "Texture failed to load at path: " << texture.m_Path << std::endl;
+			std::vector<unsigned char>().swap(texture.m_Encoded);
+		});
+	}
+
+	// creates the GL texture the first time any model asks and frees the pixels, returns its name. GL thread only
+	unsigned int Upload(CachedTexture& texture)
+	{
+		if (texture.m_Uploaded)
+			return texture.m_ID;
+		Decode(texture);
+		texture.m_ID = texture.m_Cooked ? UploadCooked(*texture.m_Cooked) : UploadPixels(texture);
+		texture.m_Pixels.reset();
+		texture.m_Cooked.reset();
+		texture.m_Uploaded = true;
+		m_Uploaded++;
+		return texture.m_ID;
+	}
+
+	// deletes the textures no model holds anymore, returns how many. GL thread only
+	int Purge()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		int purged = 0;
+		for (auto entry = m_Entries.begin(); entry != m_Entries.end();)
+		{
+			if (entry->second.use_count() > 1)
+			{
+				++entry;
+				continue;
+			}
+			if (entry->second->m_Uploaded)
+				glDeleteTextures(1, &entry->second->m_ID);
+			entry = m_Entries.erase(entry);
+			purged++;
+		}
+		m_Purged += purged;
+		return purged;
+	}
+
+	TextureCacheStats GetStats() const
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return { m_Hits, m_Misses, m_Decoded, m_Uploaded, m_Purged, m_Cooked, static_cast<int>(m_Entries.size()) };
+	}
+
+	void PrintStats() const
+	{
+		TextureCacheStats stats = GetStats();
+		std::cout << "Texture cache: " << stats.hits << " hits, " << stats.misses << " misses, " << stats.decoded << " decoded, "
+			<< stats.uploaded << " uploaded, " << stats.purged << " purged, " << stats.cooked << " cooked, " << stats.entries << " entries" << std::endl;
+	}
+
+private:
+	// content hash and size
+	typedef std::pair<uint64_t, size_t> Key;
+
+	// m_Mutex held
+	std::shared_ptr<CachedTexture> FindOrAdd(const Key& key, const std::string& path, std::vector<unsigned char> encoded,
+		std::shared_ptr<CookedTextureFile> cooked)
+	{
+		auto entry = m_Entries.find(key);
+		if (entry != m_Entries.end())
+		{
+			m_Hits++;
+			return entry->second;
+		}
+		auto texture = std::make_shared<CachedTexture>();
+		texture->m_Path = path;
+		texture->m_Encoded = std::move(encoded);
+		texture->m_Cooked = std::move(cooked);
+		m_Entries[key] = texture;
+		m_Misses++;
+		if (texture->m_Cooked)
+			m_Cooked++;
+		return texture;
+	}
+
+	// GL format of a cooked format, 0 if the driver can't sample it
+	GLenum GetCompressedFormat(uint32_t format, bool srgb)
+	{
+		if (!m_SupportQueried)
+		{
+			GLint count = 0;
+			glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+			for (GLint i = 0; i < count; i++)
+			{
+				const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+				if (std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0)
+					m_S3TC = true;
+				else if (std::strcmp(name, "GL_EXT_texture_sRGB") == 0 || std::strcmp(name, "GL_EXT_texture_compression_s3tc_srgb") == 0)
+					m_S3TCSRGB = true;
+				else if (std::strcmp(name, "GL_ARB_texture_compression_bptc") == 0)
+					m_BPTC = true;
+			}
+			m_SupportQueried = true;
+		}
+		switch (format)
+		{
+		case TextureFormatBC1: return !m_S3TC ? 0 : srgb ? (m_S3TCSRGB ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : 0) : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		case TextureFormatBC3: return !m_S3TC ? 0 : srgb ? (m_S3TCSRGB ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : 0) : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		case TextureFormatBC5: return GL_COMPRESSED_RG_RGTC2;
+		case TextureFormatBC7: return !m_BPTC ? 0 : srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+		default: return 0;
+		}
+	}
+
+	// the cooked mip chain as it is, or decoded here when the driver lacks the format
+	unsigned int UploadCooked(const CookedTextureFile& file)
+	{
+		const CookedTextureHeader& header = file.GetHeader();
+		bool srgb = header.srgb != 0 && m_GammaCorrection;
+		GLenum internalFormat = GetCompressedFormat(header.format, srgb);
+
+		unsigned int textureID;
+		glGenTextures(1, &textureID);
+		glBindTexture(GL_TEXTURE_2D, textureID);
+		for (int i = 0; i < file.GetNumMips(); i++)
+		{
+			const CookedTextureMip& mip = file.GetMip(i);
+			if (internalFormat)
+			{
+				glCompressedTexImage2D(GL_TEXTURE_2D, i, internalFormat, mip.width, mip.height, 0, static_cast<GLsizei>(mip.dataSize), file.GetMipData(i));
+			}
+			else
+			{
+				TextureImage image = DecompressImage(file.GetMipData(i), mip.width, mip.height, header.format);
+				glTexImage2D(GL_TEXTURE_2D, i, srgb ? GL_SRGB8_ALPHA8 : GL_RGBA, mip.width, mip.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.rgba.data());
+			}
+		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, file.GetNumMips() - 1);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		return textureID;
+	}
+
+	static unsigned int UploadPixels(const CachedTexture& texture)
+	{
+		unsigned int textureID;
+		glGenTextures(1, &textureID);
+		if (!texture.m_Pixels)
+			return textureID;
+
+		GLenum format;
+		if (texture.m_Components == 1)
+			format = GL_RED;
+		else if (texture.m_Components == 3)
+			format = GL_RGB;
+		else if (texture.m_Components == 4)
+			format = GL_RGBA;
+
+		glBindTexture(GL_TEXTURE_2D, textureID);
+		glTexImage2D(GL_TEXTURE_2D, 0, format, texture.m_Width, texture.m_Height, 0, format, GL_UNSIGNED_BYTE, texture.m_Pixels.get());
+		glGenerateMipmap(GL_TEXTURE_2D);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		return textureID;
+	}
+
+	mutable std::mutex m_Mutex;
+	std::map<Key, std::shared_ptr<CachedTexture>> m_Entries;
+	std::map<std::string, std::pair<FileStamp, Key>> m_Paths;
+	int m_Hits = 0;
+	int m_Misses = 0;
+	std::atomic<int> m_Decoded{ 0 };
+	std::atomic<int> m_Uploaded{ 0 };
+	int m_Purged = 0;
+	int m_Cooked = 0;
+
+	// GL thread only
+	bool m_GammaCorrection = false;
+	bool m_SupportQueried = false;
+	bool m_S3TC = false;
+	bool m_S3TCSRGB = false;
+	bool m_BPTC = false;
+};
+
+// the cache every Model shares
+inline TextureCache& GetTextureCache()
+{
+	static TextureCache cache;
+	return cache;
+}
@@ -0,0 +1,692 @@
+#pragma once
+
+/* CPU block compression for cooked textures: encoders for BC1 (RGB), BC3 (BC1 colour + BC4 alpha),
+   BC5 (two BC4 channels, normal maps) and BC7 mode 6 (RGBA), the matching decoders for the PSNR report and for
+   drivers without S3TC/BPTC, and mip chain generation. Images are RGBA8, blocks 4x4 texels of 8 or 16 bytes.
+   Endpoints come from the principal axis of the block's colours, refined once by least squares. */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include <learnopengl/thread_pool.h>
+
+enum CookedTextureFormat : uint32_t
+{
+	TextureFormatBC1 = 1,
+	TextureFormatBC3 = 2,
+	TextureFormatBC5 = 3,
+	TextureFormatBC7 = 4,
+};
+
+inline int GetBlockSize(uint32_t format)
+{
+	return format == TextureFormatBC1 ? 8 : 16;
+}
+
+inline const char* GetTextureFormatName(uint32_t format)
+{
+	switch (format)
+	{
+	case TextureFormatBC1: return "BC1";
+	case TextureFormatBC3: return "BC3";
+	case TextureFormatBC5: return "BC5";
+	case TextureFormatBC7: return "BC7";
+	default: return "unknown";
+	}
+}
+
+struct TextureImage
+{
+	int width = 0;
+	int height = 0;
+	std::vector<unsigned char> rgba;
+};
+
+namespace BlockCompression
+{
+	// principal axis of count points of dims channels by power iteration, false if they are all the same
+	inline bool PrincipalAxis(const float (*points)[4], int count, int dims, float mean[4], float axis[4])
+	{
+		for (int c = 0; c < 4; c++)
+			mean[c] = 0.0f;
+		for (int i = 0; i < count; i++)
+			for (int c = 0; c < dims; c++)
+				mean[c] += points[i][c] / count;
+
+		float covariance[4][4] = {};
+		for (int i = 0; i < count; i++)
+			for (int a = 0; a < dims; a++)
+				for (int b = 0; b < dims; b++)
+					covariance[a][b] += (points[i][a] - mean[a]) * (points[i][b] - mean[b]);
+
+		for (int c = 0; c < 4; c++)
+			axis[c] = c < dims ? 1.0f : 0.0f;
+		float length = 0.0f;
+		for (int iteration = 0; iteration < 8; iteration++)
+		{
+			float next[4] = {};
+			for (int a = 0; a < dims; a++)
+				for (int b = 0; b < dims; b++)
+					next[a] += covariance[a][b] * axis[b];
+			length = 0.0f;
+			for (int c = 0; c < dims; c++)
+				length += next[c] * next[c];
+			length = std::sqrt(length);
+			if (length < 1e-6f)
+				return false;
+			for (int c = 0; c < dims; c++)
+				axis[c] = next[c] / length;
+		}
+		return true;
+	}
+
+	// endpoints a and b minimising the squared error of points against a + weight * (b - a)
+	inline bool LeastSquares(const float (*points)[4], const float* weights, int count, int dims, float a[4], float b[4])
+	{
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+		float ax[4] = {}, bx[4] = {};
+		for (int i = 0; i < count; i++)
+		{
+			float t = weights[i];
+			aa += (1.0f - t) * (1.0f - t);
+			ab += (1.0f - t) * t;
+			bb += t * t;
+			for (int c = 0; c < dims; c++)
+			{
+				ax[c] += (1.0f - t) * points[i][c];
+				bx[c] += t * points[i][c];
+			}
+		}
+		float determinant = aa * bb - ab * ab;
+		if (std::fabs(determinant) < 1e-6f)
+			return false;
+		for (int c = 0; c < dims; c++)
+		{
+			a[c] = std::min(255.0f, std::max(0.0f, (ax[c] * bb - bx[c] * ab) / determinant));
+			b[c] = std::min(255.0f, std::max(0.0f, (bx[c] * aa - ax[c] * ab) / determinant));
+		}
+		return true;
+	}
+
+	inline void ExtractBlock(const TextureImage& image, int blockX, int blockY, unsigned char block[64])
+	{
+		for (int y = 0; y < 4; y++)
+		{
+			int sy = std::min(blockY * 4 + y, image.height - 1);
+			for (int x = 0; x < 4; x++)
+			{
+				int sx = std::min(blockX * 4 + x, image.width - 1);
+				std::memcpy(&block[(y * 4 + x) * 4], &image.rgba[(sy * image.width + sx) * 4], 4);
+			}
+		}
+	}
+
+	inline void StoreBlock(TextureImage& image, int blockX, int blockY, const unsigned char block[64])
+	{
+		for (int y = 0; y < 4 && blockY * 4 + y < image.height; y++)
+			for (int x = 0; x < 4 && blockX * 4 + x < image.width; x++)
+				std::memcpy(&image.rgba[((blockY * 4 + y) * image.width + blockX * 4 + x) * 4], &block[(y * 4 + x) * 4], 4);
+	}
+
+	inline uint16_t PackRGB565(const float color[3])
+	{
+		int r = static_cast<int>(std::lround(color[0] * 31.0f / 255.0f));
+		int g = static_cast<int>(std::lround(color[1] * 63.0f / 255.0f));
+		int b = static_cast<int>(std::lround(color[2] * 31.0f / 255.0f));
+		return static_cast<uint16_t>((std::min(31, std::max(0, r)) << 11) | (std::min(63, std::max(0, g)) << 5) | std::min(31, std::max(0, b)));
+	}
+
+	inline void UnpackRGB565(uint16_t packed, int color[3])
+	{
+		int r = packed >> 11, g = (packed >> 5) & 63, b = packed & 31;
+		color[0] = (r << 3) | (r >> 2);
+		color[1] = (g << 2) | (g >> 4);
+		color[2] = (b << 3) | (b >> 2);
+	}
+
+	// the four-colour palette of a BC1 block with color0 > color1
+	inline void BC1Palette(uint16_t color0, uint16_t color1, int palette[4][3])
+	{
+		UnpackRGB565(color0, palette[0]);
+		UnpackRGB565(color1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+	}
+
+	inline float FitBC1(const float (*points)[4], uint16_t color0, uint16_t color1, uint32_t& indices)
+	{
+		int palette[4][3];
+		BC1Palette(color0, color1, palette);
+		float error = 0.0f;
+		indices = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0;
+			float bestError = std::numeric_limits<float>::max();
+			for (int p = 0; p < 4; p++)
+			{
+				float e = 0.0f;
+				for (int c = 0; c < 3; c++)
+					e += (points[i][c] - palette[p][c]) * (points[i][c] - palette[p][c]);
+				if (e < bestError)
+				{
+					bestError = e;
+					best = p;
+				}
+			}
+			indices |= uint32_t(best) << (2 * i);
+			error += bestError;
+		}
+		return error;
+	}
+
+	// packs the endpoints as color0 > color1 so the block decodes in four-colour mode, swapping indices to match
+	inline float EncodeBC1Endpoints(const float (*points)[4], const float a[3], const float b[3], uint16_t& color0, uint16_t& color1, uint32_t& indices)
+	{
+		color0 = PackRGB565(a);
+		color1 = PackRGB565(b);
+		if (color0 < color1)
+			std::swap(color0, color1);
+		if (color0 == color1)
+		{
+			indices = 0;
+			int palette[4][3];
+			BC1Palette(color0, color1, palette);
+			float error = 0.0f;
+			for (int i = 0; i < 16; i++)
+				for (int c = 0; c < 3; c++)
+					error += (points[i][c] - palette[0][c]) * (points[i][c] - palette[0][c]);
+			return error;
+		}
+		return FitBC1(points, color0, color1, indices);
+	}
+
+	inline void EncodeBC1(const unsigned char block[64], unsigned char out[8])
+	{
+		float points[16][4];
+		for (int i = 0; i < 16; i++)
+			for (int c = 0; c < 4; c++)
+				points[i][c] = block[i * 4 + c];
+
+		float mean[4], axis[4], a[4], b[4];
+		if (PrincipalAxis(points, 16, 3, mean, axis))
+		{
+			float low = std::numeric_limits<float>::max(), high = -low;
+			for (int i = 0; i < 16; i++)
+			{
+				float t = (points[i][0] - mean[0]) * axis[0] + (points[i][1] - mean[1]) * axis[1] + (points[i][2] - mean[2]) * axis[2];
+				low = std::min(low, t);
+				high = std::max(high, t);
+			}
+			for (int c = 0; c < 3; c++)
+			{
+				a[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * high));
+				b[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * low));
+			}
+		}
+		else
+		{
+			for (int c = 0; c < 3; c++)
+				a[c] = b[c] = mean[c];
+		}
+
+		uint16_t color0, color1;
+		uint32_t indices;
+		float error = EncodeBC1Endpoints(points, a, b, color0, color1, indices);
+
+		// one least squares pass over the chosen indices
+		static const float Weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+		float weights[16];
+		for (int i = 0; i < 16; i++)
+			weights[i] = Weights[(indices >> (2 * i)) & 3];
+		if (error > 0.0f && LeastSquares(points, weights, 16, 3, a, b))
+		{
+			uint16_t refined0, refined1;
+			uint32_t refinedIndices;
+			float refinedError = EncodeBC1Endpoints(points, a, b, refined0, refined1, refinedIndices);
+			if (refinedError < error)
+			{
+				color0 = refined0;
+				color1 = refined1;
+				indices = refinedIndices;
+			}
+		}
+
+		out[0] = color0 & 0xFF;
+		out[1] = color0 >> 8;
+		out[2] = color1 & 0xFF;
+		out[3] = color1 >> 8;
+		for (int i = 0; i < 4; i++)
+			out[4 + i] = (indices >> (8 * i)) & 0xFF;
+	}
+
+	inline void DecodeBC1(const unsigned char in[8], unsigned char block[64])
+	{
+		uint16_t color0 = in[0] | (in[1] << 8);
+		uint16_t color1 = in[2] | (in[3] << 8);
+		uint32_t indices = in[4] | (in[5] << 8) | (in[6] << 16) | (uint32_t(in[7]) << 24);
+		int palette[4][3];
+		BC1Palette(color0, color1, palette);
+		int alpha3 = 255;
+		if (color0 <= color1)
+		{
+			// three-colour mode, only produced by other encoders
+			for (int c = 0; c < 3; c++)
+			{
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+				palette[3][c] = 0;
+			}
+			alpha3 = 0;
+		}
+		for (int i = 0; i < 16; i++)
+		{
+			int index = (indices >> (2 * i)) & 3;
+			for (int c = 0; c < 3; c++)
+				block[i * 4 + c] = static_cast<unsigned char>(palette[index][c]);
+			block[i * 4 + 3] = static_cast<unsigned char>(index == 3 ? alpha3 : 255);
+		}
+	}
+
+	// one channel in eight-value mode, endpoints at the block's range
+	inline void EncodeBC4(const unsigned char block[64], int channel, unsigned char out[8])
+	{
+		int low = 255, high = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			low = std::min(low, int(block[i * 4 + channel]));
+			high = std::max(high, int(block[i * 4 + channel]));
+		}
+		out[0] = static_cast<unsigned char>(high);
+		out[1] = static_cast<unsigned char>(low);
+		uint64_t indices = 0;
+		if (high > low)
+		{
+			int palette[8] = { high, low };
+			for (int p = 2; p < 8; p++)
+				palette[p] = ((8 - p) * high + (p - 1) * low) / 7;
+			for (int i = 0; i < 16; i++)
+			{
+				int value = block[i * 4 + channel];
+				int best = 0;
+				for (int p = 1; p < 8; p++)
+					if (std::abs(palette[p] - value) < std::abs(palette[best] - value))
+						best = p;
+				indices |= uint64_t(best) << (3 * i);
+			}
+		}
+		for (int i = 0; i < 6; i++)
+			out[2 + i] = (indices >> (8 * i)) & 0xFF;
+	}
+
+	inline void DecodeBC4(const unsigned char in[8], int channel, unsigned char block[64])
+	{
+		int palette[8] = { in[0], in[1] };
+		if (in[0] > in[1])
+		{
+			for (int p = 2; p < 8; p++)
+				palette[p] = ((8 - p) * in[0] + (p - 1) * in[1]) / 7;
+		}
+		else
+		{
+			for (int p = 2; p < 6; p++)
+				palette[p] = ((6 - p) * in[0] + (p - 1) * in[1]) / 5;
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+		uint64_t indices = 0;
+		for (int i = 0; i < 6; i++)
+			indices |= uint64_t(in[2 + i]) << (8 * i);
+		for (int i = 0; i < 16; i++)
+			block[i * 4 + channel] = static_cast<unsigned char>(palette[(indices >> (3 * i)) & 7]);
+	}
+
+	inline void EncodeBC3(const unsigned char block[64], unsigned char out[16])
+	{
+		EncodeBC4(block, 3, out);
+		EncodeBC1(block, out + 8);
+	}
+
+	inline void DecodeBC3(const unsigned char in[16], unsigned char block[64])
+	{
+		DecodeBC1(in + 8, block);
+		DecodeBC4(in, 3, block);
+	}
+
+	inline void EncodeBC5(const unsigned char block[64], unsigned char out[16])
+	{
+		EncodeBC4(block, 0, out);
+		EncodeBC4(block, 1, out + 8);
+	}
+
+	inline void DecodeBC5(const unsigned char in[16], unsigned char block[64])
+	{
+		DecodeBC4(in, 0, block);
+		DecodeBC4(in + 8, 1, block);
+		for (int i = 0; i < 16; i++)
+		{
+			block[i * 4 + 2] = 0;
+			block[i * 4 + 3] = 255;
+		}
+	}
+
+	// BC7 mode 6: one subset, RGBA endpoints of 7 bits plus a shared low bit each, 4 bit indices
+	static const int BC7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// the 7 bit endpoint and low bit closest to a colour
+	inline void QuantizeBC7Endpoint(const float color[4], int quantized[4], int& pbit)
+	{
+		float bestError = std::numeric_limits<float>::max();
+		for (int p = 0; p < 2; p++)
+		{
+			int candidate[4];
+			float error = 0.0f;
+			for (int c = 0; c < 4; c++)
+			{
+				candidate[c] = std::min(127, std::max(0, static_cast<int>(std::lround((color[c] - p) / 2.0f))));
+				float value = float((candidate[c] << 1) | p);
+				error += (value - color[c]) * (value - color[c]);
+			}
+			if (error < bestError)
+			{
+				bestError = error;
+				pbit = p;
+				std::memcpy(quantized, candidate, sizeof(candidate));
+			}
+		}
+	}
+
+	inline float FitBC7(const float (*points)[4], const int e0[4], int p0, const int e1[4], int p1, int indices[16])
+	{
+		int palette[16][4];
+		for (int c = 0; c < 4; c++)
+		{
+			int v0 = (e0[c] << 1) | p0, v1 = (e1[c] << 1) | p1;
+			for (int p = 0; p < 16; p++)
+				palette[p][c] = ((64 - BC7Weights[p]) * v0 + BC7Weights[p] * v1 + 32) >> 6;
+		}
+		float error = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			float bestError = std::numeric_limits<float>::max();
+			for (int p = 0; p < 16; p++)
+			{
+				float e = 0.0f;
+				for (int c = 0; c < 4; c++)
+					e += (points[i][c] - palette[p][c]) * (points[i][c] - palette[p][c]);
+				if (e < bestError)
+				{
+					bestError = e;
+					indices[i] = p;
+				}
+			}
+			error += bestError;
+		}
+		return error;
+	}
+
+	inline float EncodeBC7Endpoints(const float (*points)[4], const float a[4], const float b[4], int e0[4], int& p0, int e1[4], int& p1, int indices[16])
+	{
+		QuantizeBC7Endpoint(a, e0, p0);
+		QuantizeBC7Endpoint(b, e1, p1);
+		return FitBC7(points, e0, p0, e1, p1, indices);
+	}
+
+	inline void EncodeBC7(const unsigned char block[64], unsigned char out[16])
+	{
+		float points[16][4];
+		for (int i = 0; i < 16; i++)
+			for (int c = 0; c < 4; c++)
+				points[i][c] = block[i * 4 + c];
+
+		float mean[4], axis[4], a[4], b[4];
+		if (PrincipalAxis(points, 16, 4, mean, axis))
+		{
+			float low = std::numeric_limits<float>::max(), high = -low;
+			for (int i = 0; i < 16; i++)
+			{
+				float t = 0.0f;
+				for (int c = 0; c < 4; c++)
+					t += (points[i][c] - mean[c]) * axis[c];
+				low = std::min(low, t);
+				high = std::max(high, t);
+			}
+			for (int c = 0; c < 4; c++)
+			{
+				a[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * low));
+				b[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * high));
+			}
+		}
+		else
+		{
+			for (int c = 0; c < 4; c++)
+				a[c] = b[c] = mean[c];
+		}
+
+		int e0[4], e1[4], p0, p1, indices[16];
+		float error = EncodeBC7Endpoints(points, a, b, e0, p0, e1, p1, indices);
+
+		float weights[16];
+		for (int i = 0; i < 16; i++)
+			weights[i] = BC7Weights[indices[i]] / 64.0f;
+		if (error > 0.0f && LeastSquares(points, weights, 16, 4, a, b))
+		{
+			int r0[4], r1[4], rp0, rp1, refinedIndices[16];
+			float refinedError = EncodeBC7Endpoints(points, a, b, r0, rp0, r1, rp1, refinedIndices);
+			if (refinedError < error)
+			{
+				std::memcpy(e0, r0, sizeof(r0));
+				std::memcpy(e1, r1, sizeof(r1));
+				std::memcpy(indices, refinedIndices, sizeof(refinedIndices));
+				p0 = rp0;
+				p1 = rp1;
+			}
+		}
+
+		// the first index is stored without its top bit, so it has to be below 8
+		if (indices[0] >= 8)
+		{
+			for (int c = 0; c < 4; c++)
+				std::swap(e0[c], e1[c]);
+			std::swap(p0, p1);
+			for (int i = 0; i < 16; i++)
+				indices[i] = 15 - indices[i];
+		}
+
+		std::memset(out, 0, 16);
+		int bit = 0;
+		auto write = [&](uint32_t value, int bits)
+		{
+			for (int i = 0; i < bits; i++, bit++)
+				out[bit >> 3] |= ((value >> i) & 1) << (bit & 7);
+		};
+		write(1 << 6, 7);
+		for (int c = 0; c < 4; c++)
+		{
+			write(e0[c], 7);
+			write(e1[c], 7);
+		}
+		write(p0, 1);
+		write(p1, 1);
+		write(indices[0], 3);
+		for (int i = 1; i < 16; i++)
+			write(indices[i], 4);
+	}
+
+	// mode 6 only, the one EncodeBC7 writes; other modes decode to magenta
+	inline void DecodeBC7(const unsigned char in[16], unsigned char block[64])
+	{
+		int bit = 0;
+		auto read = [&](int bits)
+		{
+			uint32_t value = 0;
+			for (int i = 0; i < bits; i++, bit++)
+				value |= uint32_t((in[bit >> 3] >> (bit & 7)) & 1) << i;
+			return static_cast<int>(value);
+		};
+		if (read(7) != (1 << 6))
+		{
+			for (int i = 0; i < 16; i++)
+			{
+				block[i * 4 + 0] = 255;
+				block[i * 4 + 1] = 0;
+				block[i * 4 + 2] = 255;
+				block[i * 4 + 3] = 255;
+			}
+			return;
+		}
+		int e0[4], e1[4];
+		for (int c = 0; c < 4; c++)
+		{
+			e0[c] = read(7);
+			e1[c] = read(7);
+		}
+		int p0 = read(1), p1 = read(1);
+		for (int i = 0; i < 16; i++)
+		{
+			int weight = BC7Weights[read(i == 0 ? 3 : 4)];
+			for (int c = 0; c < 4; c++)
+			{
+				int v0 = (e0[c] << 1) | p0, v1 = (e1[c] << 1) | p1;
+				block[i * 4 + c] = static_cast<unsigned char>(((64 - weight) * v0 + weight * v1 + 32) >> 6);
+			}
+		}
+	}
+
+	inline float SRGBToLinear(float value)
+	{
+		return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+	}
+
+	inline float LinearToSRGB(float value)
+	{
+		return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+	}
+}
+
+inline std::vector<unsigned char> CompressImage(const TextureImage& image, uint32_t format)
+{
+	int blocksX = (image.width + 3) / 4, blocksY = (image.height + 3) / 4;
+	int blockSize = GetBlockSize(format);
+	std::vector<unsigned char> data(size_t(blocksX) * blocksY * blockSize);
+	GetThreadPool().ParallelFor(blocksY, [&](int y)
+	{
+		unsigned char block[64];
+		for (int x = 0; x < blocksX; x++)
+		{
+			BlockCompression::ExtractBlock(image, x, y, block);
+			unsigned char* out = &data[(size_t(y) * blocksX + x) * blockSize];
+			if (format == TextureFormatBC1)
+				BlockCompression::EncodeBC1(block, out);
+			else if (format == TextureFormatBC3)
+				BlockCompression::EncodeBC3(block, out);
+			else if (format == TextureFormatBC5)
+				BlockCompression::EncodeBC5(block, out);
+			else
+				BlockCompression::EncodeBC7(block, out);
+		}
+	});
+	return data;
+}
+
+inline TextureImage DecompressImage(const unsigned char* data, int width, int height, uint32_t format)
+{
+	TextureImage image;
+	image.width = width;
+	image.height = height;
+	image.rgba.resize(size_t(width) * height * 4);
+	int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+	int blockSize = GetBlockSize(format);
+	unsigned char block[64];
+	for (int y = 0; y < blocksY; y++)
+	{
+		for (int x = 0; x < blocksX; x++)
+		{
+			const unsigned char* in = data + (size_t(y) * blocksX + x) * blockSize;
+			if (format == TextureFormatBC1)
+				BlockCompression::DecodeBC1(in, block);
+			else if (format == TextureFormatBC3)
+				BlockCompression::DecodeBC3(in, block);
+			else if (format == TextureFormatBC5)
+				BlockCompression::DecodeBC5(in, block);
+			else
+				BlockCompression::DecodeBC7(in, block);
+			BlockCompression::StoreBlock(image, x, y, block);
+		}
+	}
+	return image;
+}
+
+// next mip level by a 2x2 box filter. Colour data is averaged in linear space, normal maps are renormalised
+inline TextureImage DownsampleImage(const TextureImage& image, bool srgb, bool normalMap)
+{
+	TextureImage mip;
+	mip.width = std::max(1, image.width / 2);
+	mip.height = std::max(1, image.height / 2);
+	mip.rgba.resize(size_t(mip.width) * mip.height * 4);
+
+	float toLinear[256];
+	for (int i = 0; i < 256; i++)
+		toLinear[i] = srgb ? BlockCompression::SRGBToLinear(i / 255.0f) : i / 255.0f;
+
+	for (int y = 0; y < mip.height; y++)
+	{
+		for (int x = 0; x < mip.width; x++)
+		{
+			float sum[4] = {};
+			for (int dy = 0; dy < 2; dy++)
+			{
+				for (int dx = 0; dx < 2; dx++)
+				{
+					int sx = std::min(x * 2 + dx, image.width - 1), sy = std::min(y * 2 + dy, image.height - 1);
+					const unsigned char* texel = &image.rgba[(size_t(sy) * image.width + sx) * 4];
+					for (int c = 0; c < 3; c++)
+						sum[c] += normalMap ? texel[c] / 127.5f - 1.0f : toLinear[texel[c]];
+					sum[3] += texel[3] / 255.0f;
+				}
+			}
+			unsigned char* texel = &mip.rgba[(size_t(y) * mip.width + x) * 4];
+			if (normalMap)
+			{
+				float length = std::sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+				for (int c = 0; c < 3; c++)
+				{
+					float value = length > 0.0f ? sum[c] / length : 0.0f;
+					texel[c] = static_cast<unsigned char>(std::lround((value + 1.0f) * 127.5f));
+				}
+			}
+			else
+			{
+				for (int c = 0; c < 3; c++)
+				{
+					float value = sum[c] / 4.0f;
+					texel[c] = static_cast<unsigned char>(std::lround((srgb ? BlockCompression::LinearToSRGB(value) : value) * 255.0f));
+				}
+			}
+			texel[3] = static_cast<unsigned char>(std::lround(sum[3] / 4.0f * 255.0f));
+		}
+	}
+	return mip;
+}
+
+// peak signal to noise ratio over the first channels of two images of the same size, infinity if they are equal
+inline double ComputePSNR(const TextureImage& a, const TextureImage& b, int channels)
+{
+	double sum = 0.0;
+	size_t count = size_t(a.width) * a.height;
+	for (size_t i = 0; i < count; i++)
+	{
+		for (int c = 0; c < channels; c++)
+		{
+			double difference = double(a.rgba[i * 4 + c]) - double(b.rgba[i * 4 + c]);
+			sum += difference * difference;
+		}
+	}
+	double mse = sum / (count * channels);
+	return mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : std::numeric_limits<double>::infinity();
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+/* Fixed set of worker threads running submitted tasks in submission order.
+   Only CPU work goes here: the GL context is current on the render thread alone. */
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+	// numThreads 0 starts one worker per core, less the one the render loop runs on
+	explicit ThreadPool(int numThreads = 0)
+	{
+		if (numThreads <= 0)
+			numThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+		for (int i = 0; i < numThreads; i++)
+			m_Threads.emplace_back([this]() { WorkerLoop(); });
+	}
+
+	// finishes the tasks already submitted, then joins the workers
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Stop = true;
+		}
+		m_Condition.notify_all();
+		for (std::thread& thread : m_Threads)
+			thread.join();
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	template<typename F>
+	auto Submit(F task) -> std::future<decltype(task())>
+	{
+		using Result = decltype(task());
+		auto packaged = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+		std::future<Result> future = packaged->get_future();
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Tasks.push_back([packaged]() { (*packaged)(); });
+		}
+		m_Condition.notify_one();
+		return future;
+	}
+
+	// runs body(i) for every i in [0, count) on the workers and the calling thread, returns when all are done.
+	// The caller works through the items as well and only waits for items already running, so this is safe
+	// from inside a task of the same pool. Helpers that start after the items ran out return at once
+	template<typename F>
+	void ParallelFor(int count, const F& body)
+	{
+		if (count <= 0)
+			return;
+		struct Job
+		{
+			std::atomic<int> next{ 0 };
+			std::atomic<int> done{ 0 };
+			std::mutex mutex;
+			std::condition_variable finished;
+		};
+		auto job = std::make_shared<Job>();
+		const F* items = &body;
+		auto work = [job, items, count]()
+		{
+			for (int i = job->next++; i < count; i = job->next++)
+			{
+				(*items)(i);
+				if (++job->done == count)
+				{
+					std::lock_guard<std::mutex> lock(job->mutex);
+					job->finished.notify_all();
+				}
+			}
+		};
+
+		int helpers = std::min(count - 1, GetNumThreads());
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			for (int i = 0; i < helpers; i++)
+				m_Tasks.push_back(work);
+		}
+		m_Condition.notify_all();
+		work();
+
+		std::unique_lock<std::mutex> lock(job->mutex);
+		job->finished.wait(lock, [&]() { return job->done == count; });
+	}
+
+	int GetNumThreads() const { return static_cast<int>(m_Threads.size()); }
+
+private:
+	void WorkerLoop()
+	{
+		for (;;)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(m_Mutex);
+				m_Condition.wait(lock, [this]() { return m_Stop || !m_Tasks.empty(); });
+				if (m_Tasks.empty())
+					return;
+				task = std::move(m_Tasks.front());
+				m_Tasks.pop_front();
+			}
+			task();
+		}
+	}
+
+	std::vector<std::thread> m_Threads;
+	std::deque<std::function<void()>> m_Tasks;
+	std::mutex m_Mutex;
+	std::condition_variable m_Condition;
+	bool m_Stop = false;
+};
+
+// the pool asset loading shares, started on first use
+inline ThreadPool& GetThreadPool()
+{
+	static ThreadPool pool;
+	return pool;
+}
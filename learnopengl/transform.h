@@ -0,0 +1,78 @@
+#pragma once
+
+/* Local bone pose as translation, rotation and scale, and the affine (3x4) math used by the hierarchy pass.
+   An affine transform is a glm::mat4x3: three basis columns and the translation, the last row is implicitly 0 0 0 1. */
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+struct Transform
+{
+	glm::vec3 translation = glm::vec3(0.0f);
+	glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	glm::vec3 scale = glm::vec3(1.0f);
+};
+
+// translate * rotate * scale written straight into the affine matrix, no intermediate mat4 products
+inline glm::mat4x3 ComposeAffine(const Transform& transform)
+{
+	const glm::quat& q = transform.rotation;
+	const glm::vec3& s = transform.scale;
+	float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+	float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+	float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+	glm::mat4x3 m;
+	m[0] = glm::vec3(1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy)) * s.x;
+	m[1] = glm::vec3(2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx)) * s.y;
+	m[2] = glm::vec3(2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy)) * s.z;
+	m[3] = transform.translation;
+	return m;
+}
+
+inline glm::mat4x3 MulAffine(const glm::mat4x3& a, const glm::mat4x3& b)
+{
+	glm::mat4x3 m;
+	m[0] = a[0] * b[0].x + a[1] * b[0].y + a[2] * b[0].z;
+	m[1] = a[0] * b[1].x + a[1] * b[1].y + a[2] * b[1].z;
+	m[2] = a[0] * b[2].x + a[1] * b[2].y + a[2] * b[2].z;
+	m[3] = a[0] * b[3].x + a[1] * b[3].y + a[2] * b[3].z + a[3];
+	return m;
+}
+
+inline glm::mat4x3 ToAffine(const glm::mat4& m)
+{
+	return glm::mat4x3(glm::vec3(m[0]), glm::vec3(m[1]), glm::vec3(m[2]), glm::vec3(m[3]));
+}
+
+inline glm::mat4 ToMat4(const glm::mat4x3& m)
+{
+	return glm::mat4(glm::vec4(m[0], 0.0f), glm::vec4(m[1], 0.0f), glm::vec4(m[2], 0.0f), glm::vec4(m[3], 1.0f));
+}
+
+// splits an affine matrix without shear into translation, rotation and scale
+inline Transform DecomposeTransform(const glm::mat4& m)
+{
+	Transform transform;
+	transform.translation = glm::vec3(m[3]);
+	glm::mat3 basis(m);
+	transform.scale = glm::vec3(glm::length(basis[0]), glm::length(basis[1]), glm::length(basis[2]));
+	if (glm::determinant(basis) < 0.0f)
+		transform.scale.x = -transform.scale.x;
+	for (int i = 0; i < 3; i++)
+		if (transform.scale[i] != 0.0f)
+			basis[i] /= transform.scale[i];
+	transform.rotation = glm::normalize(glm::quat_cast(basis));
+	return transform;
+}
+
+// linear blend of two poses, rotations by nlerp in the shortest hemisphere
+inline Transform BlendTransforms(const Transform& a, const Transform& b, float weight)
+{
+	Transform result;
+	result.translation = glm::mix(a.translation, b.translation, weight);
+	result.scale = glm::mix(a.scale, b.scale, weight);
+	glm::quat target = glm::dot(a.rotation, b.rotation) < 0.0f ? -b.rotation : b.rotation;
+	result.rotation = glm::normalize(a.rotation * (1.0f - weight) + target * weight);
+	return result;
+}
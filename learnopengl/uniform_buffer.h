@@ -0,0 +1,190 @@
+#pragma once
+
+/* std140 uniform blocks shared between programs. The camera block is written once per frame and the character
+   block once per drawn character; both are sub-allocated from a UniformRing and attached to their fixed binding
+   point with glBindBufferRange, so a program only needs its blocks pointed at those bindings once after linking. */
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/dual_quaternion.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// binding points every program's blocks are attached to, see Shader::bindUniformBlock
+const GLuint CameraBlockBinding = 0;
+const GLuint CharacterBlockBinding = 1;
+
+// size of the palette in the Character block, MAX_BONES in the skinning shaders
+const int MaxCharacterBones = 100;
+// the DUAL_QUATERNION variant's palette, its MAX_BONES: two vec4 a bone fit twice the bones in the same block size
+const int MaxDualQuatBones = 2 * MaxCharacterBones;
+
+// layout(std140) uniform Camera
+struct CameraBlock
+{
+	glm::mat4 projection;
+	glm::mat4 view;
+};
+
+// layout(std140) uniform Character
+struct CharacterBlock
+{
+	glm::mat4 model;
+	glm::mat4 finalBonesMatrices[MaxCharacterBones];
+
+	// copies the first MaxCharacterBones matrices of palette
+	void SetPalette(const std::vector<glm::mat4>& palette)
+	{
+		size_t count = std::min(palette.size(), size_t(MaxCharacterBones));
+		std::memcpy(finalBonesMatrices, palette.data(), count * sizeof(glm::mat4));
+	}
+};
+
+// layout(std140) uniform Character of the DUAL_QUATERNION variant, the size of CharacterBlock with twice the bones
+struct CharacterDualQuatBlock
+{
+	glm::mat4 model;
+	glm::vec4 boneDualQuats[2 * MaxDualQuatBones];	// real, dual
+
+	void SetPalette(const std::vector<glm::dualquat>& palette)
+	{
+		size_t count = std::min(palette.size(), size_t(MaxDualQuatBones));
+		for (size_t i = 0; i < count; i++)
+			DualQuaternion::Pack(palette[i], &boneDualQuats[2 * i]);
+	}
+
+	// converts a matrix palette, e.g. a Blender's
+	void SetPalette(const std::vector<glm::mat4>& palette)
+	{
+		size_t count = std::min(palette.size(), size_t(MaxDualQuatBones));
+		for (size_t i = 0; i < count; i++)
+			DualQuaternion::Pack(DualQuaternion::FromMatrix(palette[i]), &boneDualQuats[2 * i]);
+	}
+};
+
+// one uniform buffer split into a segment per frame in flight. Blocks pushed during a frame are written into that
+// frame's segment through an unsynchronized mapping; a fence per segment keeps the CPU from overwriting a segment
+// the GPU hasn't finished reading
+class UniformRing
+{
+public:
+	// frameSize bytes of blocks per frame, numFrames frames in flight. Every block takes GetAlignedSize() of its size,
+	// so size frames from that rather than sizeof
+	UniformRing(GLsizeiptr frameSize, int numFrames = 3)
+		:
+		m_Fences(numFrames, nullptr)
+	{
+		m_Alignment = GetOffsetAlignment();
+		m_FrameSize = Align(frameSize);
+
+		glGenBuffers(1, &m_Buffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, m_Buffer);
+		glBufferData(GL_UNIFORM_BUFFER, m_FrameSize * numFrames, nullptr, GL_STREAM_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	~UniformRing()
+	{
+		for (GLsync fence : m_Fences)
+			if (fence)
+				glDeleteSync(fence);
+		glDeleteBuffers(1, &m_Buffer);
+	}
+
+	UniformRing(const UniformRing&) = delete;
+	UniformRing& operator=(const UniformRing&) = delete;
+
+	// moves to the next frame's segment, waiting for the GPU if it still reads it
+	void BeginFrame()
+	{
+		m_Frame = (m_Frame + 1) % m_Fences.size();
+		GLsync& fence = m_Fences[m_Frame];
+		if (fence)
+		{
+			GLenum result = glClientWaitSync(fence, 0, 0);
+			while (result == GL_TIMEOUT_EXPIRED)
+				result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+		m_Used = 0;
+	}
+
+	// fences the segment written this frame, after its last draw
+	void EndFrame()
+	{
+		m_Fences[m_Frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	// copies size bytes of block into this frame's segment, returns its offset or -1 when the segment is full
+	GLintptr Push(const void* block, GLsizeiptr size)
+	{
+		if (m_Used + size > m_FrameSize)
+		{
+			std::cout << "ERROR::UNIFORM_RING:: frame segment of " << m_FrameSize << " bytes is full" << std::endl;
+			return -1;
+		}
+		GLintptr offset = m_Frame * m_FrameSize + m_Used;
+		m_Used += Align(size);
+
+		glBindBuffer(GL_UNIFORM_BUFFER, m_Buffer);
+		void* data = glMapBufferRange(GL_UNIFORM_BUFFER, offset, size,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (data)
+		{
+			std::memcpy(data, block, size);
+			glUnmapBuffer(GL_UNIFORM_BUFFER);
+		}
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		return data ? offset : -1;
+	}
+
+	template<typename T>
+	GLintptr Push(const T& block)
+	{
+		return Push(&block, sizeof(T));
+	}
+
+	// attaches a block pushed this frame to binding, the one call switching characters costs
+	bool Bind(GLuint binding, GLintptr offset, GLsizeiptr size) const
+	{
+		if (offset < 0)
+			return false;
+		glBindBufferRange(GL_UNIFORM_BUFFER, binding, m_Buffer, offset, size);
+		return true;
+	}
+
+	// the bytes a block of size takes in a frame's segment, padded to the offset alignment; needs the GL context
+	static GLsizeiptr GetAlignedSize(GLsizeiptr size)
+	{
+		GLsizeiptr alignment = GetOffsetAlignment();
+		return (size + alignment - 1) / alignment * alignment;
+	}
+
+	template<typename T>
+	static GLsizeiptr GetAlignedSize()
+	{
+		return GetAlignedSize(sizeof(T));
+	}
+
+private:
+	static GLsizeiptr GetOffsetAlignment()
+	{
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		return std::max(alignment, 1);
+	}
+
+	GLsizeiptr Align(GLsizeiptr size) const { return (size + m_Alignment - 1) / m_Alignment * m_Alignment; }
+
+	GLuint m_Buffer = 0;
+	GLsizeiptr m_FrameSize = 0;
+	GLsizeiptr m_Alignment = 256;
+	GLsizeiptr m_Used = 0;
+	size_t m_Frame = 0;
+	std::vector<GLsync> m_Fences;
+};
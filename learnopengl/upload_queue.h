@@ -0,0 +1,96 @@
+#pragma once
+
+/* GL work handed from loader threads to the thread owning the context.
+   Any thread pushes without taking a lock: nodes are linked in with one atomic exchange (Vyukov's intrusive MPSC queue).
+   The context thread alone drains it, in push order, until the frame's time budget is used up. */
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+class UploadQueue
+{
+public:
+	UploadQueue()
+		:
+		m_Head(&m_Stub),
+		m_Tail(&m_Stub)
+	{
+	}
+
+	~UploadQueue()
+	{
+		Node* node = m_Tail;
+		while (node)
+		{
+			Node* next = node->next.load(std::memory_order_relaxed);
+			if (node != &m_Stub)
+				delete node;
+			node = next;
+		}
+	}
+
+	UploadQueue(const UploadQueue&) = delete;
+	UploadQueue& operator=(const UploadQueue&) = delete;
+
+	// any thread
+	void Push(std::function<void()> task)
+	{
+		Node* node = new Node();
+		node->task = std::move(task);
+		m_Pushed.fetch_add(1, std::memory_order_relaxed);
+		Node* previous = m_Head.exchange(node, std::memory_order_acq_rel);
+		previous->next.store(node, std::memory_order_release);
+	}
+
+	// context thread only: runs queued tasks until none is left or budgetMs has passed. At least one runs per call,
+	// so a frame always makes progress however long a single upload takes. Returns the number run
+	int Drain(double budgetMs)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		int run = 0;
+		std::function<void()> task;
+		while (Pop(task))
+		{
+			task();
+			task = nullptr;
+			run++;
+			m_Completed.fetch_add(1, std::memory_order_relaxed);
+			if (std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() >= budgetMs)
+				break;
+		}
+		return run;
+	}
+
+	int GetNumPushed() const { return m_Pushed.load(std::memory_order_relaxed); }
+	int GetNumCompleted() const { return m_Completed.load(std::memory_order_relaxed); }
+
+private:
+	struct Node
+	{
+		std::atomic<Node*> next{ nullptr };
+		std::function<void()> task;
+	};
+
+	// the tail is a node whose task was already taken, its successor holds the oldest task.
+	// A push that has swapped the head but not linked its node yet reads as empty until the next call
+	bool Pop(std::function<void()>& task)
+	{
+		Node* tail = m_Tail;
+		Node* next = tail->next.load(std::memory_order_acquire);
+		if (!next)
+			return false;
+		m_Tail = next;
+		task = std::move(next->task);
+		next->task = nullptr;
+		if (tail != &m_Stub)
+			delete tail;
+		return true;
+	}
+
+	Node m_Stub;
+	std::atomic<Node*> m_Head;
+	Node* m_Tail;
+	std::atomic<int> m_Pushed{ 0 };
+	std::atomic<int> m_Completed{ 0 };
+};
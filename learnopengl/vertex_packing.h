@@ -0,0 +1,144 @@
+#pragma once
+
+/* Compact GPU layouts for mesh vertices. Position stays float; the normal and tangent are octahedral-encoded
+   snorm16 pairs, the bitangent is rebuilt in the vertex shader from cross(normal, tangent) and a sign kept in the
+   tangent's lowest bit; UVs are half floats; bone weights are unorm and quantized to sum to exactly one.
+   Decoded by anim_model.vs when PACKED_VERTEX is set. */
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+enum VertexFormat
+{
+	VertexFormatFull,		// Vertex as it is, 88 bytes
+	VertexFormatPacked,		// PackedVertex, 32 bytes, for skeletons of up to 256 bones
+	VertexFormatPackedWide,	// PackedVertexWide, 40 bytes, 16 bit bone ids and weights
+};
+
+struct PackedVertex
+{
+	float Position[3];
+	int16_t Normal[2];		// octahedral, snorm
+	int16_t Tangent[2];		// octahedral, snorm; lowest bit of [1] set when the bitangent is -cross(normal, tangent)
+	uint16_t TexCoords[2];	// half
+	uint8_t BoneIDs[4];
+	uint8_t Weights[4];		// unorm, sum 255 on skinned vertices
+};
+
+struct PackedVertexWide
+{
+	float Position[3];
+	int16_t Normal[2];
+	int16_t Tangent[2];
+	uint16_t TexCoords[2];
+	uint16_t BoneIDs[4];
+	uint16_t Weights[4];	// unorm, sum 65535 on skinned vertices
+};
+
+static_assert(sizeof(PackedVertex) == 32, "PackedVertex must stay 32 bytes");
+static_assert(sizeof(PackedVertexWide) == 40, "PackedVertexWide must stay 40 bytes");
+
+// the vertex bytes a mesh uploads in place of its Vertex array
+struct PackedVertices
+{
+	VertexFormat format = VertexFormatFull;
+	std::vector<unsigned char> data;
+};
+
+namespace VertexPacking
+{
+	// unit vector to the octahedron folded onto [-1, 1]^2
+	inline glm::vec2 OctEncode(const glm::vec3& v)
+	{
+		float length = std::abs(v.x) + std::abs(v.y) + std::abs(v.z);
+		if (length <= 0.0f)
+			return glm::vec2(0.0f, 0.0f);
+		glm::vec3 n = v / length;
+		if (n.z >= 0.0f)
+			return glm::vec2(n.x, n.y);
+		return glm::vec2((1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f), (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+	}
+
+	inline glm::vec3 OctDecode(const glm::vec2& e)
+	{
+		glm::vec3 v(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+		if (v.z < 0.0f)
+			v = glm::vec3((1.0f - std::abs(e.y)) * (e.x >= 0.0f ? 1.0f : -1.0f), (1.0f - std::abs(e.x)) * (e.y >= 0.0f ? 1.0f : -1.0f), v.z);
+		return glm::normalize(v);
+	}
+
+	inline int16_t ToSnorm16(float value)
+	{
+		return static_cast<int16_t>(std::lround(glm::clamp(value, -1.0f, 1.0f) * 32767.0f));
+	}
+
+	inline void PackNormal(const glm::vec3& normal, int16_t out[2])
+	{
+		glm::vec2 e = OctEncode(normal);
+		out[0] = ToSnorm16(e.x);
+		out[1] = ToSnorm16(e.y);
+	}
+
+	// the tangent like the normal, its lowest bit swapped for the handedness of the frame
+	inline void PackTangent(const glm::vec3& normal, const glm::vec3& tangent, const glm::vec3& bitangent, int16_t out[2])
+	{
+		PackNormal(tangent, out);
+		bool flipped = glm::dot(glm::cross(normal, tangent), bitangent) < 0.0f;
+		out[1] = static_cast<int16_t>((out[1] & ~1) | (flipped ? 1 : 0));
+	}
+
+	// weights scaled to unorm values summing to exactly the type's maximum, the rounding error given to the heaviest.
+	// Unused slots (id < 0) and an unskinned vertex come out 0
+	template<typename T>
+	void QuantizeWeights(const int* ids, const float* weights, int count, T* out)
+	{
+		const int unit = static_cast<T>(~T(0));
+		float sum = 0.0f;
+		float heaviestWeight = -1.0f;
+		int heaviest = 0;
+		for (int i = 0; i < count; i++)
+		{
+			float weight = ids[i] >= 0 ? std::max(weights[i], 0.0f) : 0.0f;
+			sum += weight;
+			if (weight > heaviestWeight)
+			{
+				heaviestWeight = weight;
+				heaviest = i;
+			}
+		}
+		int total = 0;
+		for (int i = 0; i < count; i++)
+		{
+			float weight = ids[i] >= 0 && sum > 0.0f ? std::max(weights[i], 0.0f) / sum : 0.0f;
+			out[i] = static_cast<T>(std::lround(weight * unit));
+			total += out[i];
+		}
+		if (total > 0)
+			out[heaviest] = static_cast<T>(out[heaviest] + unit - total);
+	}
+
+	template<typename P>
+	void PackVertex(const glm::vec3& position, const glm::vec3& normal, const glm::vec2& texCoords, const glm::vec3& tangent,
+		const glm::vec3& bitangent, const int* ids, const float* weights, int count, P& out)
+	{
+		out.Position[0] = position.x;
+		out.Position[1] = position.y;
+		out.Position[2] = position.z;
+		PackNormal(normal, out.Normal);
+		PackTangent(normal, tangent, bitangent, out.Tangent);
+		out.TexCoords[0] = glm::packHalf1x16(texCoords.x);
+		out.TexCoords[1] = glm::packHalf1x16(texCoords.y);
+		typedef typename std::remove_reference<decltype(out.BoneIDs[0])>::type BoneID;
+		for (int i = 0; i < 4; i++)
+			out.BoneIDs[i] = static_cast<BoneID>(i < count ? std::max(ids[i], 0) : 0);
+		QuantizeWeights(ids, weights, std::min(count, 4), out.Weights);
+		for (int i = count; i < 4; i++)
+			out.Weights[i] = 0;
+	}
+}